@@ -0,0 +1,141 @@
+/* See LICENSE file for copyright and license details.
+ *
+ * Client list walks with clients from malloc against clients from the slab
+ * pool, no X server needed:
+ *
+ *   ./bench_clients [iterations]
+ *
+ * The malloc'd clients are allocated in between other allocations of varying
+ * size, the way they end up on a window manager that ran for a while. Both
+ * sets are walked like the list walks do (floating and visibility test) and
+ * like the stack walks do (geometry of every client).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/common.h"
+#include "../src/slab.h"
+#include "../src/util.h"
+
+int log_fd = 2;
+
+static const int sizes[] = { 1000, 10000 };
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void setup(Client *c, Monitor *m, int i)
+{
+    c->mon = m;
+    c->win = i + 1;
+    c->x = i % 1920;
+    c->y = i % 1080;
+    c->w = 640;
+    c->h = 480;
+    c->tags = 1u << (i % 9);
+    c->isfloating = i % 7 == 0;
+}
+
+/* list of n clients, junk holds the allocations made in between */
+static Client *build(Monitor *m, int n, SlabPool *pool, void **junk)
+{
+    Client *head = NULL, **tail = &head, *c;
+    char name[32];
+    int i;
+
+    for (i = 0; i < n; i++) {
+        if (pool) {
+            c = slaballoc(pool);
+            snprintf(name, sizeof(name), "client %d", i);
+            c->name = strstore(name);
+        } else {
+            c = ecalloc(1, sizeof(Client));
+            junk[i] = ecalloc(1, 16 + rand() % 512);
+        }
+        setup(c, m, i);
+        *tail = c;
+        tail = &c->next;
+    }
+    for (c = head; c; c = c->next)
+        c->snext = c->next;
+    return head;
+}
+
+static long walktiled(Client *c)
+{
+    long n = 0;
+
+    for (; c; c = c->next)
+        if (!c->isfloating && ISVISIBLE(c))
+            n++;
+    return n;
+}
+
+static long walkstack(Client *c)
+{
+    long sum = 0;
+
+    for (; c; c = c->snext)
+        sum += c->x + c->y + c->w + c->h;
+    return sum;
+}
+
+static void run(const char *what, Client *head, int n, long iters)
+{
+    double start, t1, t2;
+    long i, sink = 0;
+
+    start = now();
+    for (i = 0; i < iters; i++)
+        sink += walktiled(head);
+    t1 = now() - start;
+    start = now();
+    for (i = 0; i < iters; i++)
+        sink += walkstack(head);
+    t2 = now() - start;
+    printf("%-6s %6d  tiled %6.2f ns/client  stack %6.2f ns/client  (%ld)\n", what, n,
+        t1 * 1e9 / (iters * n), t2 * 1e9 / (iters * n), sink & 1);
+}
+
+int main(int argc, char *argv[])
+{
+    long iters = argc > 1 ? atol(argv[1]) : 2000;
+    SlabPool pool = SLABPOOL(Client);
+    Monitor mon = {0};
+    Client *head, *c, *next;
+    void **junk;
+    size_t s;
+    int i;
+
+    mon.tagset[0] = mon.tagset[1] = 0x1f;
+    printf("sizeof(Client) %zu\n", sizeof(Client));
+    for (s = 0; s < LENGTH(sizes); s++) {
+        junk = ecalloc(sizes[s], sizeof(void *));
+        head = build(&mon, sizes[s], NULL, junk);
+        run("malloc", head, sizes[s], iters);
+        for (c = head; c; c = next) {
+            next = c->next;
+            free(c);
+        }
+        for (i = 0; i < sizes[s]; i++)
+            free(junk[i]);
+        free(junk);
+
+        head = build(&mon, sizes[s], &pool, NULL);
+        run("slab", head, sizes[s], iters);
+        for (c = head; c; c = next) {
+            next = c->next;
+            strdrop(c->name);
+            slabfree(&pool, c);
+        }
+    }
+    slabdestroy(&pool);
+    return 0;
+}
@@ -0,0 +1,128 @@
+/* See LICENSE file for copyright and license details.
+ *
+ * Text measuring and drawing throughput of drw, meant to run against a
+ * throwaway server:
+ *
+ *   Xvfb :99 & DISPLAY=:99 ./bench_drw [font] [iterations]
+ *
+ * Every corpus is measured through drw_text() directly (no width cache),
+ * through drw_fontset_getwidth() (cached) and drawn into a bar sized pixmap.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/drw.h"
+#include "../src/util.h"
+
+int log_fd = 2;
+
+typedef struct {
+    const char *name;
+    const char *text[4];
+} Corpus;
+
+static const Corpus corpora[] = {
+    { "ascii", {
+        "user@vm01: ~/Downloads",
+        "mpwm - 1 - vim src/drw.c",
+        "Mozilla Firefox - Pull requests - some/long/repository/path",
+        "load 0.42 0.37 0.31 | mem 3.1G | 2024-06-01 12:00",
+    } },
+    { "cjk", {
+        "東京都 - 天気予報",
+        "日本語のウィンドウタイトル",
+        "中文标题 - 浏览器",
+        "한국어 제목 표시줄",
+    } },
+    { "emoji", {
+        "🎉 party 🎉",
+        "chat (3) 💬 — 👍🔥",
+        "🐧🐧🐧🐧🐧🐧🐧🐧",
+        "music ▶ 🎵 now playing 🎶",
+    } },
+    { "mixed", {
+        "[dev01] user@vm01: ~ | 東京 🌧 12°C",
+        "Ünïcödé tïtlé – ASCII mostly",
+        "build: ✔ 42 passed, ✘ 0 failed",
+        "résumé.pdf — Document Viewer",
+    } },
+};
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static size_t corpusbytes(const Corpus *c)
+{
+    size_t i, n = 0;
+
+    for (i = 0; i < LENGTH(c->text); i++)
+        n += strlen(c->text[i]);
+    return n;
+}
+
+static void report(const char *corpus, const char *what, double t, long ops, size_t bytes)
+{
+    printf("%-6s %-8s %9.1f ns/string %9.1f MB/s\n", corpus, what,
+        t * 1e9 / ops, bytes / t / 1e6);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *fonts[] = { argc > 1 ? argv[1] : "monospace:size=10" };
+    const char *colors[] = { "#bbbbbb", "#222222", "#444444" };
+    long iters = argc > 2 ? atol(argv[2]) : 20000, i;
+    unsigned int w = 1920, h = 22, sink = 0;
+    Display *dpy;
+    Drw *drw;
+    Clr *scm;
+    size_t c, t, bytes;
+    double start;
+
+    if (!(dpy = XOpenDisplay(NULL)))
+        die("bench_drw: cannot open display");
+    drw = drw_create(dpy, DefaultScreen(dpy), RootWindow(dpy, DefaultScreen(dpy)), w, h);
+    if (!drw_fontset_create(drw, fonts, LENGTH(fonts)))
+        die("bench_drw: no fonts could be loaded");
+    scm = drw_scm_create(drw, colors, LENGTH(colors));
+    drw_setscheme(drw, scm);
+
+    for (c = 0; c < LENGTH(corpora); c++) {
+        bytes = corpusbytes(&corpora[c]) * iters;
+
+        /* warm up glyph and fallback caches */
+        for (t = 0; t < LENGTH(corpora[c].text); t++)
+            drw_text(drw, 0, 0, w, h, 0, corpora[c].text[t], 0);
+        XSync(dpy, False);
+
+        start = now();
+        for (i = 0; i < iters; i++)
+            for (t = 0; t < LENGTH(corpora[c].text); t++)
+                sink += drw_text(drw, 0, 0, 0, 0, 0, corpora[c].text[t], 0);
+        report(corpora[c].name, "measure", now() - start, iters * LENGTH(corpora[c].text), bytes);
+
+        start = now();
+        for (i = 0; i < iters; i++)
+            for (t = 0; t < LENGTH(corpora[c].text); t++)
+                sink += drw_fontset_getwidth(drw, corpora[c].text[t]);
+        report(corpora[c].name, "cached", now() - start, iters * LENGTH(corpora[c].text), bytes);
+
+        start = now();
+        for (i = 0; i < iters; i++)
+            for (t = 0; t < LENGTH(corpora[c].text); t++)
+                drw_text(drw, 0, 0, w, h, 0, corpora[c].text[t], 0);
+        XSync(dpy, False);
+        report(corpora[c].name, "draw", now() - start, iters * LENGTH(corpora[c].text), bytes);
+    }
+
+    free(scm);
+    drw_free(drw);
+    XCloseDisplay(dpy);
+    return sink == 0xdeadbeef;
+}
@@ -0,0 +1,346 @@
+#include "barrender.h"
+#include "barwin.h"
+#include "config.h"
+#include "drw.h"
+#include "fontcache.h"
+#include "util.h"
+
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+/*
+ * Bars are rendered by a worker thread with its own X connection, fonts and
+ * pixmaps. drawbar() only builds a BarSnapshot and swaps it into the
+ * monitor's slot, a snapshot that was not picked up yet is simply replaced.
+ * The worker is woken through an eventfd, renders the newest snapshot of
+ * every slot and copies the result to the bar window. The geometry it used is
+ * published back through a seqlock so the event thread can hit-test clicks
+ * without measuring text.
+ *
+ * If the second connection can not be set up everything is rendered on the
+ * event thread with gdrw instead.
+ *
+ * Fallback fonts are looked up in the background (drw_fallback_async()),
+ * segments that were drawn with placeholder boxes are redrawn from the
+ * slot's last snapshot once the fonts are there.
+ *
+ * Other text of mpwm's own windows (the overview's tag names) goes through
+ * the same worker as BarLabels, pushed onto a lock-free list.
+ */
+
+static BarSlot slots[MAXBARSLOTS];
+static Display *rdpy;
+static Drw *rdrw;
+static pthread_t rthread;
+static int threaded;
+static int efd = -1;
+static atomic_int running;
+static _Atomic(BarLabel *) labels;
+static BarLabel *waitlabels;  /* drawn with placeholder boxes, renderer only */
+static Pixmap labelpix;
+static int labelpixw, labelpixh;
+
+static void rendersnapshot(BarSlot *s, Drw *drw, BarSnapshot *snap)
+{
+    renderbar(drw, s, snap);
+    snap->full = 0;
+    free(s->last);
+    s->last = snap;
+}
+
+static void renderslot(BarSlot *s, Drw *drw)
+{
+    BarSnapshot *snap;
+
+    if ((snap = atomic_exchange_explicit(&s->pending, NULL, memory_order_acquire)))
+        rendersnapshot(s, drw, snap);
+}
+
+/* draw l, keeping it around if it still waits for fallback fonts */
+static void renderlabel(Drw *drw, BarLabel *l)
+{
+    unsigned int mark = drw->placeholders;
+
+    if (!labelpix || labelpixw < l->w || labelpixh < l->h) {
+        if (labelpix)
+            XFreePixmap(drw->dpy, labelpix);
+        labelpixw = MAX(labelpixw, l->w);
+        labelpixh = MAX(labelpixh, l->h);
+        labelpix = XCreatePixmap(drw->dpy, drw->root, labelpixw, labelpixh, DefaultDepth(drw->dpy, drw->screen));
+    }
+    drw_setdrawable(drw, labelpix, labelpixw, labelpixh);
+    drw_setscheme(drw, l->scheme);
+    drw_text(drw, 0, 0, l->w, l->h, drw->fonts->h / 2, l->text, 0);
+    /* the window may be gone already, the error is ignored */
+    drw_map(drw, l->win, 0, 0, l->w, l->h);
+    if (drw->placeholders != mark) {
+        l->next = waitlabels;
+        waitlabels = l;
+    } else {
+        free(l);
+    }
+}
+
+static void renderlabels(Drw *drw)
+{
+    BarLabel *l, *next;
+
+    for (l = atomic_exchange_explicit(&labels, NULL, memory_order_acquire); l; l = next) {
+        next = l->next;
+        renderlabel(drw, l);
+    }
+}
+
+/* open fallback fonts that were found and redraw what waited for them */
+static void fontsarrived(Drw *drw)
+{
+    BarSlot *s;
+    BarLabel *l, *next;
+    int i, j;
+
+    if (!drw_fallback_collect(drw))
+        return;
+    /* the last lookup of a burst came in, remember the results on disk */
+    if (drw_fallback_idle(drw))
+        fontcachesync();
+    l = waitlabels;
+    waitlabels = NULL;
+    for (; l; l = next) {
+        next = l->next;
+        renderlabel(drw, l);
+    }
+    for (i = 0; i < MAXBARSLOTS; i++) {
+        s = &slots[i];
+        if (!s->waiting || !s->last)
+            continue;
+        for (j = 0; j < SegLast; j++)
+            if (s->waiting & 1 << j)
+                s->seg[j].hash = 0;
+        /* a pending snapshot redraws them anyway */
+        if (!atomic_load_explicit(&s->pending, memory_order_relaxed))
+            renderbar(drw, s, s->last);
+    }
+}
+
+static void wake(__attribute__((unused)) void *arg)
+{
+    if (write(efd, &(uint64_t){1}, sizeof(uint64_t)) < 0) {
+        DBG("wake: eventfd write failed\n");
+    }
+}
+
+static void *renderloop(__attribute__((unused)) void *arg)
+{
+    struct pollfd pfd[2];
+    uint64_t v;
+    XEvent ev;
+    int i;
+
+    pfd[0].fd = efd;
+    pfd[0].events = POLLIN;
+    pfd[1].fd = ConnectionNumber(rdpy);
+    pfd[1].events = POLLIN;
+
+    while (atomic_load(&running)) {
+        fontsarrived(rdrw);
+        for (i = 0; i < MAXBARSLOTS; i++)
+            renderslot(&slots[i], rdrw);
+        renderlabels(rdrw);
+        XFlush(rdpy);
+        /* nothing is selected on this connection, this only reads errors */
+        while (XPending(rdpy))
+            XNextEvent(rdpy, &ev);
+        if (poll(pfd, 2, -1) > 0 && pfd[0].revents & POLLIN)
+            if (read(efd, &v, sizeof(v)) < 0)
+                break;
+    }
+    return NULL;
+}
+
+static int startrenderer(void)
+{
+    if (!(rdpy = XOpenDisplay(NULL))) {
+        fputs("mpwm: no second connection, rendering bars synchronously\n", stderr);
+        return 0;
+    }
+    rdrw = drw_create(rdpy, DefaultScreen(rdpy), RootWindow(rdpy, DefaultScreen(rdpy)), 0, 0);
+    if (!drw_fontset_create(rdrw, gcfg.fonts, gcfg.fonts_len)
+    || (efd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) < 0) {
+        drw_free(rdrw);
+        XCloseDisplay(rdpy);
+        rdpy = NULL;
+        return 0;
+    }
+    drw_fallback_async(rdrw, wake, NULL);
+    atomic_store(&running, 1);
+    if (pthread_create(&rthread, NULL, renderloop, NULL)) {
+        drw_free(rdrw);
+        close(efd);
+        XCloseDisplay(rdpy);
+        rdpy = NULL;
+        return 0;
+    }
+    return 1;
+}
+
+void barrenderinit(void)
+{
+    /* rendering inline, arrived fonts show up with the next bar update */
+    if (!(threaded = startrenderer()))
+        drw_fallback_async(gdrw, NULL, NULL);
+    drw_fallback_cache(threaded ? rdrw : gdrw, fontcachelookup, fontcachestore);
+}
+
+void barrendercleanup(void)
+{
+    Display *dpy = threaded ? rdpy : gwm.dpy;
+    BarLabel *l, *next;
+    int i;
+
+    if (threaded) {
+        atomic_store(&running, 0);
+        if (write(efd, &(uint64_t){1}, sizeof(uint64_t)) < 0)
+            pthread_cancel(rthread);
+        pthread_join(rthread, NULL);
+    }
+    for (i = 0; i < MAXBARSLOTS; i++) {
+        free(atomic_exchange(&slots[i].pending, NULL));
+        free(slots[i].last);
+        slots[i].last = NULL;
+        if (slots[i].pix)
+            XFreePixmap(dpy, slots[i].pix);
+        slots[i].pix = None;
+    }
+    for (l = atomic_exchange(&labels, NULL); l; l = next) {
+        next = l->next;
+        free(l);
+    }
+    for (l = waitlabels; l; l = next) {
+        next = l->next;
+        free(l);
+    }
+    waitlabels = NULL;
+    if (labelpix)
+        XFreePixmap(dpy, labelpix);
+    labelpix = None;
+    labelpixw = labelpixh = 0;
+    if (threaded) {
+        /* stops the resolver, which may still wake us */
+        drw_free(rdrw);
+        close(efd);
+        XCloseDisplay(rdpy);
+        threaded = 0;
+    }
+}
+
+BarSlot *barslotget(void)
+{
+    int i;
+
+    for (i = 0; i < MAXBARSLOTS; i++)
+        if (!slots[i].used) {
+            slots[i].used = 1;
+            return &slots[i];
+        }
+    return NULL;
+}
+
+/* the renderer drops the slot's pixmap once it sees the empty snapshot */
+void barslotrelease(BarSlot *s)
+{
+    BarSnapshot *snap = ecalloc(1, sizeof(BarSnapshot));
+
+    snap->barwin = None;
+    barsubmit(s, snap);
+    s->used = 0;
+}
+
+void barsubmit(BarSlot *s, BarSnapshot *snap)
+{
+    BarSnapshot *old;
+
+    if (!threaded) {
+        rendersnapshot(s, gdrw, snap);
+        fontsarrived(gdrw);
+        return;
+    }
+    if ((old = atomic_exchange_explicit(&s->pending, snap, memory_order_acq_rel))) {
+        /* replaced before it was rendered, keep its request for a full redraw */
+        snap->full |= old->full;
+        free(old);
+    }
+    if (write(efd, &(uint64_t){1}, sizeof(uint64_t)) < 0) {
+        DBG("barsubmit: eventfd write failed\n");
+    }
+}
+
+void barlabel(Window win, int w, int h, Clr *scheme, const char *text)
+{
+    BarLabel *l;
+
+    if (w <= 0 || h <= 0)
+        return;
+    l = ecalloc(1, sizeof(BarLabel));
+    l->win = win;
+    l->w = w;
+    l->h = h;
+    memcpy(l->scheme, scheme, sizeof(l->scheme));
+    snprintf(l->text, sizeof(l->text), "%s", text);
+    if (!threaded) {
+        renderlabel(gdrw, l);
+        fontsarrived(gdrw);
+        return;
+    }
+    l->next = atomic_load_explicit(&labels, memory_order_relaxed);
+    while (!atomic_compare_exchange_weak_explicit(&labels, &l->next, l,
+        memory_order_release, memory_order_relaxed));
+    if (write(efd, &(uint64_t){1}, sizeof(uint64_t)) < 0) {
+        DBG("barlabel: eventfd write failed\n");
+    }
+}
+
+void barpublishlayout(BarSlot *s, const BarLayout *l)
+{
+    unsigned int seq = atomic_load_explicit(&s->seq, memory_order_relaxed);
+
+    atomic_store_explicit(&s->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    memcpy(&s->layout, l, sizeof(BarLayout));
+    atomic_store_explicit(&s->seq, seq + 2, memory_order_release);
+}
+
+void barlayout(BarSlot *s, BarLayout *l)
+{
+    unsigned int seq;
+
+    if (!s) {
+        memset(l, 0, sizeof(BarLayout));
+        return;
+    }
+    do {
+        while ((seq = atomic_load_explicit(&s->seq, memory_order_acquire)) & 1);
+        memcpy(l, &s->layout, sizeof(BarLayout));
+        atomic_thread_fence(memory_order_acquire);
+    } while (seq != atomic_load_explicit(&s->seq, memory_order_relaxed));
+}
+
+/* range under x, NULL if x is in none of them */
+const BarRange *barhit(const BarLayout *l, int x)
+{
+    int lo = 0, hi = l->nranges, mid;
+
+    /* first range that ends right of x */
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (l->range[mid].x1 <= x)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo < l->nranges && l->range[lo].x0 <= x ? &l->range[lo] : NULL;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "common.h"
+
+#include <stdatomic.h>
+
+#define MAXBARSLOTS 32
+#define BARPOOL     2048
+#define BARTITLES   32    /* clients with their own title span */
+#define BARRANGES   (MAXTAGS + 3 + BARTITLES)
+#define BARLABEL    256
+
+/* immutable description of one bar, built on the event thread */
+typedef struct {
+    Window barwin;        /* None releases the slot */
+    int ww, bh;
+    int full;             /* window content was lost, redraw every segment */
+    int showstatus;
+    int showtitle;        /* some device pair is on the monitor */
+    Clr scheme[SchemeSel3 + 1][ColBorder3 + 1];
+    int statusscm, ltscm, titlescm;
+    unsigned int ntags;   /* tags shown, only occupied or viewed ones */
+    int tagidx[MAXTAGS];  /* tag of each shown one */
+    int tagscm[MAXTAGS];
+    Tagset occ, urg, selt;
+    int tagoff[MAXTAGS], ltoff, titleoff, statusoff; /* strings in pool */
+    int ntitles;
+    int titlecut[BARTITLES];      /* where each client's part of the title starts */
+    Window titlewin[BARTITLES];
+    char pool[BARPOOL];
+} BarSnapshot;
+
+/* title of a monitor's bar, composed again only after titlechanged() */
+struct BarTitle {
+    int valid;
+    int len;
+    int ntitles;
+    int cut[BARTITLES];
+    Window win[BARTITLES];
+    char text[BARPOOL];
+};
+
+typedef struct {
+    int x0, x1;           /* covers [x0, x1) */
+    int click;            /* ClkTagBar, ClkLtSymbol, ClkWinTitle or ClkStatusText */
+    unsigned int tag;     /* ClkTagBar: index of the tag */
+    Window win;           /* ClkWinTitle: client of the span, None outside of them */
+} BarRange;
+
+/*
+ * bar geometry as last rendered, used by the event thread for hit-testing.
+ * The ranges are sorted and do not overlap.
+ */
+typedef struct {
+    int nranges;
+    BarRange range[BARRANGES];
+} BarLayout;
+
+struct BarSlot {
+    _Atomic(BarSnapshot *) pending;
+    atomic_uint seq;      /* seqlock around layout */
+    BarLayout layout;
+    int used;             /* event thread only */
+
+    /* owned by the renderer */
+    Window win;
+    Pixmap pix;
+    int pixw, pixh;
+    BarSeg seg[SegLast];
+    BarSnapshot *last;    /* redrawn when fallback fonts arrive */
+    unsigned int waiting; /* segments showing placeholder boxes */
+};
+
+/* a line of text the renderer draws into a window of the event thread */
+typedef struct BarLabel BarLabel;
+struct BarLabel {
+    BarLabel *next;
+    Window win;
+    int w, h;
+    Clr scheme[ColBorder3 + 1];
+    char text[BARLABEL];
+};
+
+extern void barrenderinit(void);
+extern void barrendercleanup(void);
+extern BarSlot *barslotget(void);
+extern void barslotrelease(BarSlot *s);
+extern void barsubmit(BarSlot *s, BarSnapshot *snap);
+extern void barlabel(Window win, int w, int h, Clr *scheme, const char *text);
+extern void barpublishlayout(BarSlot *s, const BarLayout *l);
+extern void barlayout(BarSlot *s, BarLayout *l);
+extern const BarRange *barhit(const BarLayout *l, int x);
@@ -1,97 +1,428 @@
 #include "barwin.h"
+#include "barrender.h"
 #include "config.h"
 #include "drw.h"
+#include "resolvers.h"
+#include "util.h"
 
-void drawbar(Monitor *m)
+#include <stdarg.h>
+#include <time.h>
+
+/*
+ * remember what a segment shows, returns 1 when it has to be redrawn. The
+ * geometry is part of the hash so moved segments are redrawn as well.
+ */
+static int segchanged(BarSlot *s, int seg, int x, int w, uint64_t hash)
 {
-    char focus_text[512];
-    int fti = 0, rfti = 0;
-    int x, w, sw = 0;
-    int boxs = gdrw->fonts->h / 9;
-    int boxw = gdrw->fonts->h / 6 + 2;
-    unsigned int i, occ = 0, urg = 0, selt = 0;
-    Client *c;
-    DevPair *dp;
-    Clr **cur_scheme;
+    hash = hashbytes(hash, &x, sizeof(x));
+    hash = hashbytes(hash, &w, sizeof(w));
+    if (s->seg[seg].hash == hash)
+        return 0;
+    s->seg[seg].x = x;
+    s->seg[seg].w = w;
+    s->seg[seg].hash = hash;
+    return 1;
+}
 
-    if(m == gwm.forcedfocusmon)
-        cur_scheme = gwm.ff_scheme;
+static uint64_t hashstr(uint64_t hash, const char *s)
+{
+    return hashbytes(hash, s, strlen(s) + 1);
+}
+
+static uint64_t hashscm(uint64_t hash, const Clr *scm)
+{
+    return hashbytes(hash, scm, sizeof(Clr) * (ColBorder3 + 1));
+}
+
+/* remember whether a segment just drawn shows glyphs that are still being looked up */
+static void segwaiting(Drw *drw, BarSlot *s, int seg, unsigned int mark)
+{
+    if (drw->placeholders != mark)
+        s->waiting |= 1 << seg;
     else
-        cur_scheme = gwm.scheme;
+        s->waiting &= ~(1 << seg);
+}
 
-    if (!m->showbar)
+static unsigned int textw(Drw *drw, const char *text)
+{
+    return drw_fontset_getwidth(drw, text) + drw->fonts->h;
+}
+
+/* point drw at the slot's back buffer, (re)created when the bar size changed */
+static void selectbarbuffer(Drw *drw, BarSlot *s, int w, int h)
+{
+    if (!s->pix || s->pixw != w || s->pixh != h) {
+        if (s->pix)
+            XFreePixmap(drw->dpy, s->pix);
+        s->pix = XCreatePixmap(drw->dpy, drw->root, w, h, DefaultDepth(drw->dpy, drw->screen));
+        s->pixw = w;
+        s->pixh = h;
+        memset(s->seg, 0, sizeof(s->seg));
+    }
+    drw_setdrawable(drw, s->pix, w, h);
+}
+
+/* append [x0, x1) to the layout, clipped against the ranges already in it */
+static void addrange(BarLayout *l, int x0, int x1, int click, unsigned int tag, Window win)
+{
+    if (l->nranges)
+        x0 = MAX(x0, l->range[l->nranges - 1].x1);
+    if (x0 >= x1 || l->nranges >= BARRANGES)
         return;
-    
+    l->range[l->nranges++] = (BarRange){ x0, x1, click, tag, win };
+}
+
+/* split the title area [x, x + w) into one range per client named in it */
+static void addtitlespans(Drw *drw, BarLayout *l, const BarSnapshot *snap, int x, int w)
+{
+    const char *title = &snap->pool[snap->titleoff];
+    char prefix[BARPOOL];
+    int i, n, x0 = x, x1, end = x + w;
+
+    for (i = 0; i < snap->ntitles && x0 < end; i++, x0 = x1) {
+        if (i + 1 < snap->ntitles) {
+            n = MIN(snap->titlecut[i + 1], BARPOOL - 1);
+            memcpy(prefix, title, n);
+            prefix[n] = '\0';
+            x1 = MIN(x + (int)drw->fonts->h / 2 + (int)drw_fontset_getwidth(drw, prefix), end);
+        } else {
+            x1 = end;
+        }
+        addrange(l, x0, x1, ClkWinTitle, 0, snap->titlewin[i]);
+    }
+    addrange(l, x0, end, ClkWinTitle, 0, None);
+}
+
+/*
+ * draw a snapshot into the slot's back buffer and copy the changed segments
+ * to the bar window. Runs on the render thread (or inline without one), so it
+ * must not look at anything but the snapshot and the slot.
+ */
+void renderbar(Drw *drw, BarSlot *s, const BarSnapshot *snap)
+{
+    const char *pool = snap->pool;
+    int lrpad = drw->fonts->h;
+    int x, w, sw = 0, bh = snap->bh, tagx[MAXTAGS + 1];
+    int boxs = drw->fonts->h / 9;
+    int boxw = drw->fonts->h / 6 + 2;
+    unsigned int i, dirty = 0, mark;
+    uint64_t hash;
+    Tagset t;
+    BarLayout l = {0};
+
+    if (!snap->barwin) {
+        if (s->pix)
+            XFreePixmap(drw->dpy, s->pix);
+        s->pix = None;
+        s->win = None;
+        s->waiting = 0;
+        return;
+    }
+    if (s->win != snap->barwin || snap->full) {
+        s->win = snap->barwin;
+        memset(s->seg, 0, sizeof(s->seg));
+    }
+    selectbarbuffer(drw, s, snap->ww, bh);
+
     /* draw status first so it can be overdrawn by tags later */
-    if (m->devices) {
-        drw_setscheme(gdrw, cur_scheme[SchemeNorm]);
-        sw = TEXTW(gwm.stext) - gwm.lrpad + 2; /* 2px right padding */
-        drw_text(gdrw, m->ww - sw, 0, sw, gwm.bh-gcfg.bhgappx, 0, gwm.stext, 0);
+    if (snap->showstatus) {
+        sw = textw(drw, &pool[snap->statusoff]) - lrpad + 2; /* 2px right padding */
+        hash = hashscm(hashstr(HASH_INIT, &pool[snap->statusoff]), snap->scheme[snap->statusscm]);
+        if (segchanged(s, SegStatus, snap->ww - sw, sw, hash)) {
+            mark = drw->placeholders;
+            drw_setscheme(drw, (Clr *)snap->scheme[snap->statusscm]);
+            drw_text(drw, snap->ww - sw, 0, sw, bh, 0, &pool[snap->statusoff], 0);
+            segwaiting(drw, s, SegStatus, mark);
+            dirty |= 1 << SegStatus;
+        }
+    } else {
+        segchanged(s, SegStatus, snap->ww, 0, HASH_INIT);
     }
 
-    for (c = m->clients; c; c = c->next) {
-        occ |= c->tags;
-        if (c->isurgent)
-            urg |= c->tags;
+    hash = hashbytes(HASH_INIT, snap->tagidx, snap->ntags * sizeof(snap->tagidx[0]));
+    for (x = 0, i = 0; i < snap->ntags; i++) {
+        tagx[i] = x;
+        hash = hashscm(hashstr(hash, &pool[snap->tagoff[i]]), snap->scheme[snap->tagscm[i]]);
+        x += textw(drw, &pool[snap->tagoff[i]]);
     }
-    x = 0;
-    for (i = 0; i < gtags_len; i++) {
-        w = TEXTW(gtags[i]);
-        drw_setscheme(gdrw, cur_scheme[m->tagset[m->seltags] & 1 << i ? CLAMP(SchemeNorm + m->devices, SchemeNorm, SchemeSel3) : SchemeNorm]);
-        drw_text(gdrw, x, 0, w, gwm.bh-gcfg.bhgappx, gwm.lrpad / 2, gtags[i], urg & 1 << i);
-        if (occ & 1 << i) {
-            for (dp = m->devstack; dp && !selt; dp = dp->mnext) {
-                selt |= dp->sel ? dp->sel->tags : 0;
-            }
-            drw_rect(gdrw, x + boxs, boxs, boxw, boxw,
-                m->devices && selt & 1 << i,
-                urg & 1 << i);
+    tagx[i] = x;
+    hash = hashbytes(hash, &snap->occ, sizeof(snap->occ));
+    hash = hashbytes(hash, &snap->urg, sizeof(snap->urg));
+    hash = hashbytes(hash, &snap->selt, sizeof(snap->selt));
+    if (segchanged(s, SegTags, 0, x, hash)) {
+        mark = drw->placeholders;
+        for (i = 0; i < snap->ntags; i++) {
+            w = tagx[i + 1] - tagx[i];
+            drw_setscheme(drw, (Clr *)snap->scheme[snap->tagscm[i]]);
+            t = TAGBIT(snap->tagidx[i]);
+            drw_text(drw, tagx[i], 0, w, bh, lrpad / 2, &pool[snap->tagoff[i]], !!(snap->urg & t));
+            if (snap->occ & t)
+                drw_rect(drw, tagx[i] + boxs, boxs, boxw, boxw, !!(snap->selt & t), !!(snap->urg & t));
         }
-        x += w;
+        segwaiting(drw, s, SegTags, mark);
+        dirty |= 1 << SegTags;
+    }
+
+    for (i = 0; i < snap->ntags; i++)
+        addrange(&l, tagx[i], tagx[i + 1], ClkTagBar, snap->tagidx[i], None);
+
+    w = textw(drw, &pool[snap->ltoff]);
+    hash = hashscm(hashstr(HASH_INIT, &pool[snap->ltoff]), snap->scheme[snap->ltscm]);
+    if (segchanged(s, SegLayout, x, w, hash)) {
+        mark = drw->placeholders;
+        drw_setscheme(drw, (Clr *)snap->scheme[snap->ltscm]);
+        drw_text(drw, x, 0, w, bh, lrpad / 2, &pool[snap->ltoff], 0);
+        segwaiting(drw, s, SegLayout, mark);
+        dirty |= 1 << SegLayout;
     }
-    w = TEXTW(m->ltsymbol);
-    drw_setscheme(gdrw, cur_scheme[SchemeNorm]);
-    x = drw_text(gdrw, x, 0, w, gwm.bh-gcfg.bhgappx, gwm.lrpad / 2, m->ltsymbol, 0);
-
-    /*
-     * 1  2  3  4  5  6  7  8  9  []=  [dev01,dev02] user@vm01: ~/Downloads | [dev03] user@vm01: ~
-    */
-    if ((w = m->ww - sw - x) > (gwm.bh-gcfg.bhgappx)) {
-        focus_text[0] = 0;
-        for (c = m->clients, i = 0; c; c = c->next) {
-            if (!c->devices)
-                continue;
-            if (!i) {
-                if ((rfti = snprintf(&focus_text[fti], sizeof(focus_text) - fti, "%s - %d - %s", c->prefix_name, m->nmaster, c->name)) < 0)
-                    break;
+    addrange(&l, x, x + w, ClkLtSymbol, 0, None);
+    x += w;
+
+    if ((w = snap->ww - sw - x) > bh) {
+        hash = hashscm(HASH_INIT, snap->scheme[snap->titlescm]);
+        if (snap->showtitle)
+            hash = hashstr(hash, &pool[snap->titleoff]);
+        if (segchanged(s, SegTitle, x, w, hash)) {
+            mark = drw->placeholders;
+            drw_setscheme(drw, (Clr *)snap->scheme[snap->titlescm]);
+            if (snap->showtitle) {
+                drw_text(drw, x, 0, w, bh, lrpad / 2, &pool[snap->titleoff], 0);
             }
             else {
-                if ((rfti = snprintf(&focus_text[fti], sizeof(focus_text) - fti, " | %s - %d - %s", c->prefix_name, m->nmaster, c->name)) < 0)
-                    break;
+                drw_rect(drw, x, 0, w, bh, 1, 1);
+                drw_text(drw, x, 0, w, bh, lrpad / 2, "", 0);
             }
-            fti += rfti;
-            i++;
+            segwaiting(drw, s, SegTitle, mark);
+            dirty |= 1 << SegTitle;
         }
-        if (m->devstack) {
-            drw_setscheme(gdrw, cur_scheme[CLAMP(SchemeNorm + m->devices, SchemeNorm, SchemeSel3)]);
-            drw_text(gdrw, x, 0, w, gwm.bh-gcfg.bhgappx, gwm.lrpad / 2, focus_text, 0);
+        if (snap->showtitle)
+            addtitlespans(drw, &l, snap, x, w);
+        else
+            addrange(&l, x, x + w, ClkWinTitle, 0, None);
+    } else {
+        segchanged(s, SegTitle, x, 0, HASH_INIT);
+    }
+    if (sw)
+        addrange(&l, snap->ww - sw, snap->ww, ClkStatusText, 0, None);
+
+    barpublishlayout(s, &l);
+
+    /* only copy what was redrawn, the rest of the window still shows it */
+    for (i = 0; i < SegLast; i++)
+        if (dirty & 1 << i && s->seg[i].w > 0)
+            drw_map(drw, snap->barwin, s->seg[i].x, 0, s->seg[i].w, bh);
+}
+
+/* copy str into the snapshot's string pool (truncating when full), returns its offset */
+static int poolput(BarSnapshot *snap, int *used, const char *str)
+{
+    int off = MIN(*used, BARPOOL - 1), n;
+
+    n = snprintf(&snap->pool[off], BARPOOL - off, "%s", str);
+    *used = off + MIN(MAX(n, 0), BARPOOL - off - 1) + 1;
+    return off;
+}
+
+/* append to the composed title, truncating when it is full */
+static void titleappend(BarTitle *t, const char *fmt, ...)
+{
+    va_list ap;
+    int n;
+
+    if (t->len >= BARPOOL - 1)
+        return;
+    va_start(ap, fmt);
+    n = vsnprintf(&t->text[t->len], BARPOOL - t->len, fmt, ap);
+    va_end(ap);
+    if (n > 0)
+        t->len = MIN(t->len + n, BARPOOL - 1);
+}
+
+/*
+ * 1  2  3  4  5  6  7  8  9  []=  [dev01,dev02] user@vm01: ~/Downloads | [dev03] user@vm01: ~
+*/
+static void composetitle(Monitor *m, BarTitle *t)
+{
+    DevPair *dp;
+    Client *c;
+    int n = 0;
+
+    t->len = t->ntitles = 0;
+    t->text[0] = '\0';
+    for (c = m->clients; c && t->len < BARPOOL - 1; c = c->next) {
+        if (!c->devices)
+            continue;
+        if (n++)
+            titleappend(t, " | ");
+        if (t->ntitles < BARTITLES) {
+            t->cut[t->ntitles] = t->len;
+            t->win[t->ntitles++] = c->win;
         }
-        else {
-            drw_setscheme(gdrw, cur_scheme[SchemeNorm]);
-            drw_rect(gdrw, x, 0, w, gwm.bh-gcfg.bhgappx, 1, 1);
-            drw_text(gdrw, x, 0, w, gwm.bh-gcfg.bhgappx, gwm.lrpad / 2, "", 0);
+        /* device prefix, only built here */
+        for (dp = c->devstack; dp; dp = dp->fnext)
+            titleappend(t, dp == c->devstack ? "[%d" : ", %d", dp->mptr->info.deviceid);
+        titleappend(t, "] - %d - %s", m->nmaster, c->name);
+    }
+    t->valid = 1;
+}
+
+void drawbar(Monitor *m)
+{
+    BarSnapshot *snap;
+    BarTitle *t;
+    int used = 0, n;
+    unsigned int i;
+    Tagset shown;
+    DevPair *dp;
+    Clr **cur_scheme;
+
+    if(m == gwm.forcedfocusmon)
+        cur_scheme = gwm.ff_scheme;
+    else
+        cur_scheme = gwm.scheme;
+
+    if (!m->showbar)
+        return;
+    if (!m->barslot && !(m->barslot = barslotget()))
+        return;
+
+    snap = ecalloc(1, sizeof(BarSnapshot));
+    snap->barwin = m->barwin;
+    snap->ww = m->ww;
+    snap->bh = gwm.bh - gcfg.bhgappx;
+    snap->full = m->barinvalid;
+    m->barinvalid = 0;
+    for (i = 0; i <= SchemeSel3; i++)
+        memcpy(snap->scheme[i], cur_scheme[i], sizeof(snap->scheme[i]));
+
+    snap->showstatus = m->devices;
+    snap->statusscm = SchemeNorm;
+    snap->statusoff = poolput(snap, &used, gwm.stext);
+
+    /* kept up to date by attach(), detach(), settags() and seturgent() */
+    snap->occ = m->occ;
+    snap->urg = m->urg;
+    for (dp = m->devstack; dp && !snap->selt; dp = dp->mnext)
+        snap->selt |= dp->sel ? dp->sel->tags : 0;
+    if (!m->devices)
+        snap->selt = 0;
+
+    /* vacant tags are left out unless they are viewed */
+    shown = (m->occ | m->tagset[m->seltags]) & TAGMASK;
+    for (snap->ntags = 0; shown; shown &= shown - 1, snap->ntags++) {
+        i = __builtin_ctzll(shown);
+        snap->tagidx[snap->ntags] = i;
+        snap->tagscm[snap->ntags] = m->tagset[m->seltags] & TAGBIT(i) ? CLAMP(SchemeNorm + m->devices, SchemeNorm, SchemeSel3) : SchemeNorm;
+        snap->tagoff[snap->ntags] = poolput(snap, &used, gtags[i]);
+    }
+    snap->ltscm = SchemeNorm;
+    snap->ltoff = poolput(snap, &used, m->ltsymbol);
+
+    snap->showtitle = m->devstack != NULL;
+    snap->titlescm = m->devstack ? CLAMP(SchemeNorm + m->devices, SchemeNorm, SchemeSel3) : SchemeNorm;
+    snap->titleoff = MIN(used, BARPOOL - 1);
+    if (snap->showtitle) {
+        if (!(t = m->bartitle))
+            t = m->bartitle = ecalloc(1, sizeof(BarTitle));
+        if (!t->valid)
+            composetitle(m, t);
+        n = MIN(t->len, BARPOOL - 1 - snap->titleoff);
+        memcpy(&snap->pool[snap->titleoff], t->text, n);
+        snap->pool[snap->titleoff + n] = '\0';
+        /* spans that were cut off with the pool */
+        for (i = 0; i < (unsigned int)t->ntitles && t->cut[i] < n; i++) {
+            snap->titlecut[i] = t->cut[i];
+            snap->titlewin[i] = t->win[i];
         }
+        snap->ntitles = i;
     }
-    
-    drw_map(gdrw, m->barwin, 0, 0, m->ww, gwm.bh-gcfg.bhgappx);
+
+    barsubmit(m->barslot, snap);
+}
+
+/* the composed title of m is stale: a title, the focus or nmaster changed */
+void titlechanged(Monitor *m)
+{
+    if (m->bartitle)
+        m->bartitle->valid = 0;
+    markbar(m);
 }
 
-void drawbars(void)
+/* the window content is gone (expose, new bar window), draw everything */
+void invalidatebar(Monitor *m)
+{
+    m->barinvalid = 1;
+}
+
+/* monitors trading places keep their bar window and its back buffer */
+void swapbar(Monitor *a, Monitor *b)
+{
+    BarSlot *s = a->barslot;
+
+    swap_ulong(&a->barwin, &b->barwin);
+    a->barslot = b->barslot;
+    b->barslot = s;
+    indexwin(a->barwin, WinBar, a);
+    indexwin(b->barwin, WinBar, b);
+    invalidatebar(a);
+    invalidatebar(b);
+    /* nmaster is part of the title and travels with the monitor */
+    titlechanged(a);
+    titlechanged(b);
+}
+
+/* the bar of m shows stale state, it is redrawn by flushbars() */
+void markbar(Monitor *m)
+{
+    m->bardirty = 1;
+    gwm.bardirty = 1;
+}
+
+void markbars(void)
 {
     Monitor *m;
 
     for (m = gwm.mons; m; m = m->next)
+        markbar(m);
+}
+
+static long nowms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+ * draw the dirty bars, called once the event queue is drained. With
+ * gcfg.barmaxfps a bar drawn less than a frame ago stays dirty, returns the
+ * milliseconds until the first of those is due or -1 if none is held back.
+ */
+int flushbars(void)
+{
+    Monitor *m;
+    long now, interval, wait = -1;
+
+    if (!gwm.bardirty)
+        return -1;
+    gwm.bardirty = 0;
+    interval = gcfg.barmaxfps > 0 ? 1000 / gcfg.barmaxfps : 0;
+    now = interval ? nowms() : 0;
+
+    for (m = gwm.mons; m; m = m->next) {
+        if (!m->bardirty)
+            continue;
+        if (interval && now - m->bardrawn < interval) {
+            wait = wait < 0 ? interval - (now - m->bardrawn) : MIN(wait, interval - (now - m->bardrawn));
+            gwm.bardirty = 1;
+            continue;
+        }
+        m->bardirty = 0;
+        m->bardrawn = now;
         drawbar(m);
+    }
+    return wait;
 }
 
 void updatebarpos(Monitor *m)
@@ -104,6 +435,7 @@ void updatebarpos(Monitor *m)
         m->wy = m->topbar ? m->wy + gwm.bh : m->wy;
     } else
         m->by = -gwm.bh;
+    topologychanged();
 }
 
 void updatebars(void)
@@ -149,10 +481,12 @@ void updatebars(void)
         XMapRaised(gwm.dpy, m->barwin);
         XSetClassHint(gwm.dpy, m->barwin, &ch);
         XISelectEvents(gwm.dpy, m->barwin, &ptrevm, 1);
+        indexwin(m->barwin, WinBar, m);
     }
 
     // create invisible window that acts as a layer between tiled and floating windows
     gwm.floating_stack_helper = XCreateSimpleWindow(gwm.dpy, gwm.root, 0, 0, 1, 1, 0, 0, 0);
+    indexwin(gwm.floating_stack_helper, WinHelper, NULL);
 
     wc.stack_mode = Above;
     wc.sibling = gwm.highest_barwin;
@@ -165,5 +499,6 @@ void updatestatus(void)
     if (!gettextprop(gwm.root, XA_WM_NAME, gwm.stext, sizeof(gwm.stext)))
         strcpy(gwm.stext, "mpwm-" VERSION);
     for (m = gwm.mons; m; m = m->next)
-        drawbar(m);
+        if (m->devices)
+            markbar(m);
 }
@@ -1,9 +1,17 @@
 #pragma once
 
 #include "common.h"
+#include "barrender.h"
+#include "drw.h"
 
 extern void drawbar(Monitor *m);
-extern void drawbars(void);
+extern void markbar(Monitor *m);
+extern void markbars(void);
+extern void titlechanged(Monitor *m);
+extern int flushbars(void);
+extern void renderbar(Drw *drw, BarSlot *s, const BarSnapshot *snap);
+extern void invalidatebar(Monitor *m);
+extern void swapbar(Monitor *a, Monitor *b);
 extern void updatebarpos(Monitor *m);
 extern void updatebars(void);
 
@@ -1,9 +1,13 @@
 #include "client.h"
+#include "barwin.h"
 #include "config.h"
 #include "util.h"
 #include "devpair.h"
 #include "monitor.h"
 #include "resolvers.h"
+#include "xstate.h"
+#include "resizesync.h"
+#include "slab.h"
 
 /* function implementations */
 void applyrules(Client *c)
@@ -25,7 +29,7 @@ void applyrules(Client *c)
 		&& (!r->class || strstr(class, r->class))
 		&& (!r->instance || strstr(instance, r->instance)))
 		{
-            DBG("found rule for %s:%s:%s, %d, %d, %d, %d\n", r->title, r->class, r->instance, r->tags, r->isfloating, r->isfullscreen, r->monitor);
+            DBG("found rule for %s:%s:%s, %llx, %d, %d, %d\n", r->title, r->class, r->instance, (unsigned long long)r->tags, r->isfloating, r->isfullscreen, r->monitor);
 			c->isfloating = r->isfloating;
 			c->isfullscreen = r->isfullscreen;
 			c->tags |= r->tags;
@@ -41,26 +45,88 @@ void applyrules(Client *c)
 	c->tags = c->tags & TAGMASK ? c->tags & TAGMASK : c->mon->tagset[c->mon->seltags];
 }
 
+/*
+ * return 1 for window types that are shown briefly and never take part in
+ * layout, focus or the client list
+ */
+static int ispopuptype(Atom wtype)
+{
+    return wtype == gwm.netatom[NetWMTooltip]
+        || wtype == gwm.netatom[NetWMPopupMenu]
+        || wtype == gwm.netatom[NetWMDropdownMenu]
+        || wtype == gwm.netatom[NetWMNotification];
+}
+
+/* clients are packed into slabs, their titles live in the string pools */
+static SlabPool clientpool = SLABPOOL(Client);
+
+static void freeclient(Client *c)
+{
+    strdrop(c->name);
+    slabfree(&clientpool, c);
+}
+
+/*
+ * minimal client record for popups: no passive grabs, no _NET_CLIENT_LIST
+ * update, no rules and no arrange. The window keeps the geometry it asked for
+ * and is mapped on top of everything.
+ */
+static void managepopup(Window w, XWindowAttributes *wa)
+{
+    Client *c;
+    Monitor *m;
+
+    DBG("+managepopup %lu\n", w);
+
+    c = slaballoc(&clientpool);
+    c->win = w;
+    c->x = wa->x;
+    c->y = wa->y;
+    c->w = wa->width;
+    c->h = wa->height;
+    c->bw = c->oldbw = wa->border_width;
+    c->isfloating = 1;
+    c->ismanaged = 1;
+    c->neverfocus = 1;
+    for (m = gwm.mons; m && INTERSECT(c->x, c->y, c->w, c->h, m) <= 0; m = m->next);
+    c->mon = m ? m : gwm.mons;
+
+    LISTPUSH(gwm.popups, gwm.popups_end, c, next, prev);
+    indexwin(w, WinPopup, c);
+
+    XSelectInput(gwm.dpy, w, StructureNotifyMask);
+    XMapRaised(gwm.dpy, w);
+}
+
+void unmanagepopup(Client *c, int destroyed)
+{
+    DBG("+unmanagepopup %lu %d\n", c->win, destroyed);
+
+    LISTREMOVE(gwm.popups, gwm.popups_end, c, next, prev);
+    unindexwin(c->win);
+    if (!destroyed)
+        XSelectInput(gwm.dpy, c->win, NoEventMask);
+    freeclient(c);
+}
+
 void manage(Window w, XWindowAttributes *wa)
 {
     Client *c, *t = NULL;
     Window trans = None;
-    XWindowChanges wc;
     DevPair *dp;
-    Clr **cur_scheme;
-    int window_type;
     int apply_rules = 0;
 
     DBG("+manage %lu\n", w);
 
-    if(gwm.forcedfocusmon)
-        cur_scheme = gwm.ff_scheme;
-    else
-        cur_scheme = gwm.scheme;
-    
-    c = ecalloc(1, sizeof(Client));
+    if (ispopuptype(getatomprop(w, gwm.netatom[NetWMWindowType]))) {
+        managepopup(w, wa);
+        return;
+    }
+
+    c = slaballoc(&clientpool);
     c->dirty_resize = True;
     c->grabbed = True;
+    c->netdesktop = -1;
     c->win = w;
     /* geometry */
     c->x = c->oldx = wa->x;
@@ -68,6 +134,7 @@ void manage(Window w, XWindowAttributes *wa)
     c->w = c->oldw = wa->width;
     c->h = c->oldh = wa->height;
     c->oldbw = wa->border_width;
+    initxstate(c, wa);
 
     updatetitle(c);
     if (XGetTransientForHint(gwm.dpy, w, &trans) && (t = wintoclient(trans))) {
@@ -91,14 +158,8 @@ void manage(Window w, XWindowAttributes *wa)
     c->y = MAX(c->y, c->mon->wy);
     c->bw = gcfg.borderpx;
 
-    if((window_type = updatewindowtype(c)) < 2)
-    {
-        wc.border_width = c->bw;
-        XConfigureWindow(gwm.dpy, w, CWBorderWidth, &wc);
-        XSetWindowBorder(gwm.dpy, w, cur_scheme[SchemeNorm][ColBorder].pixel);
-        if(!window_type)
-            configure(c); /* propagates border_width, if size doesn't change */
-    }
+    /* border width and colour are propagated by the commit below */
+    updatewindowtype(c);
 
     updatesizehints(c);
     updatewmhints(c);
@@ -125,12 +186,13 @@ void manage(Window w, XWindowAttributes *wa)
     if(!wintoclient(w))
     {
         DBG("-manage closed %lu %d %d\n", w, c->isfloating, c->isfullscreen);
-        free(c);
+        freeclient(c);
         return;
     }
 
     setfloating(c, c->isfloating, 1, 0);
     XSelectInput(gwm.dpy, w, PropertyChangeMask|StructureNotifyMask);
+    commit(); /* map with the final border, state and stacking */
     XMapWindow(gwm.dpy, c->win);
 
     if(!c->isfloating && !c->isfullscreen)
@@ -162,11 +224,13 @@ void unmanage(Client *c, int destroyed)
     Monitor *m = c->mon;
     XWindowChanges wc;
     DevPair *dp;
+    long data[] = { WithdrawnState, None };
 
     DBG("+unmanage %lu %d %d %d\n", c->win, c->isfloating, c->isfullscreen, destroyed);
 
     detach(c);
     detachstack(c);
+    syncfree(c);
 
     if (!destroyed) {
         wc.border_width = c->oldbw;
@@ -175,7 +239,10 @@ void unmanage(Client *c, int destroyed)
         XSelectInput(gwm.dpy, c->win, NoEventMask);
         XConfigureWindow(gwm.dpy, c->win, CWBorderWidth, &wc); /* restore border */
         XIUngrabButton(gwm.dpy, XIAllMasterDevices, XIAnyButton, c->win, ganymodifier_len, ganymodifier);
-        setclientstate(c, WithdrawnState);
+        /* c is about to be freed, no later commit will see it */
+        c->xs.state = c->state = WithdrawnState;
+        XChangeProperty(gwm.dpy, c->win, gwm.wmatom[WMState], gwm.wmatom[WMState], 32, PropModeReplace, (unsigned char *)data, 2);
+        XDeleteProperty(gwm.dpy, c->win, gwm.netatom[NetWMDesktop]);
         XSetErrorHandler(xerror);
         XUngrabServer(gwm.dpy);
     }
@@ -199,83 +266,151 @@ void unmanage(Client *c, int destroyed)
         arrange(m);
 
     DBG("-unmanage %lu %d %d\n", c->win, c->isfloating, c->isfullscreen);
-    free(c);
+    freeclient(c);
 }
 
-void attach(Client *c)
+static void counturgent(Monitor *m, Tagset tags, int d)
 {
-    c->next = c->mon->clients;
-    c->mon->clients = c;
+    unsigned int i;
+
+    for (; tags; tags &= tags - 1) {
+        i = __builtin_ctzll(tags);
+        if ((m->tagurg[i] += d))
+            m->urg |= TAGBIT(i);
+        else
+            m->urg &= ~TAGBIT(i);
+    }
 }
 
-void append(Client *c)
+/*
+ * add c to (d = 1) or remove it from (d = -1) the per tag arrays and
+ * counters of its monitor, which keep m->occ and m->urg without walking the
+ * client list and let updatetiled() and showhide() visit only the clients of
+ * the tags they care about
+ */
+static void counttags(Client *c, int d)
 {
-    Client *tc;
-    if(!c->mon->clients)
-    {
-        c->mon->clients = c;
+    Monitor *m = c->mon;
+    Client **a;
+    Tagset t;
+    unsigned int i, j;
+
+    if (c->counted == (d > 0))
         return;
+    c->counted = d > 0;
+    for (t = c->tags; t; t &= t - 1) {
+        i = __builtin_ctzll(t);
+        a = m->tagclients[i];
+        if (d > 0) {
+            if (m->tagocc[i] == m->tagclientscap[i]) {
+                m->tagclientscap[i] = m->tagclientscap[i] ? 2 * m->tagclientscap[i] : 8;
+                if (!(a = m->tagclients[i] = realloc(a, m->tagclientscap[i] * sizeof(Client *))))
+                    die("realloc:");
+            }
+            a[m->tagocc[i]] = c;
+        } else {
+            for (j = 0; a[j] != c; j++);
+            a[j] = a[m->tagocc[i] - 1];
+        }
+        if ((m->tagocc[i] += d))
+            m->occ |= TAGBIT(i);
+        else
+            m->occ &= ~TAGBIT(i);
     }
-    for (tc = c->mon->clients; tc->next; tc = tc->next);
-    tc->next = c;
-    c->next = NULL;
+    if (c->isurgent)
+        counturgent(m, c->tags, d);
+    if (c->tags & m->tagset[m->seltags])
+        m->tileddirty = 1;
+    /* showhide() only visits the viewed tags, commit() hides it if it left them */
+    markdirty(c);
+    markbar(m);
+    if (c->devices)
+        titlechanged(m);
 }
 
-void detach(Client *c)
+void attach(Client *c)
 {
-    Client **tc;
+    LISTPUSH(c->mon->clients, c->mon->clients_end, c, next, prev);
+    c->order = --c->mon->orderfirst;
+    counttags(c, 1);
+    indexwin(c->win, WinClient, c);
+    gwm.stackdirty = 1;
+}
 
-    for (tc = &c->mon->clients; *tc && *tc != c; tc = &(*tc)->next);
-    *tc = c->next;
-    c->next = NULL;
+void append(Client *c)
+{
+    LISTAPPEND(c->mon->clients, c->mon->clients_end, c, next, prev);
+    c->order = ++c->mon->orderlast;
+    counttags(c, 1);
+    indexwin(c->win, WinClient, c);
 }
 
-void attachstack(Client *c)
+void detach(Client *c)
 {
-    c->snext = c->mon->stack;
-    c->mon->stack = c;
+    LISTREMOVE(c->mon->clients, c->mon->clients_end, c, next, prev);
+    counttags(c, -1);
+    unindexwin(c->win);
 }
 
-void detachstack(Client *c)
+/* clients in a monitor's list are counted, the others only change the field */
+void settags(Client *c, Tagset tags)
+{
+    int counted = c->counted;
+
+    if (counted)
+        counttags(c, -1);
+    c->tags = tags;
+    if (counted)
+        counttags(c, 1);
+}
+
+static void setisurgent(Client *c, int urg)
 {
-    Client **tc;
+    if (c->isurgent == urg)
+        return;
+    c->isurgent = urg;
+    if (c->counted) {
+        counturgent(c->mon, c->tags, urg ? 1 : -1);
+        markbar(c->mon);
+    }
+}
 
-    for (tc = &c->mon->stack; *tc && *tc != c; tc = &(*tc)->snext);
-    *tc = c->snext;
+void attachstack(Client *c)
+{
+    LISTPUSH(c->mon->stack, c->mon->stack_end, c, snext, sprev);
+    c->stackpos = --c->mon->stackfirst;
 }
 
-Client *nexttiled(Client *c)
+void detachstack(Client *c)
 {
-    for (; c && (c->isfloating || !ISVISIBLE(c)); c = c->next);
-    return c;
+    LISTREMOVE(c->mon->stack, c->mon->stack_end, c, snext, sprev);
+    c->stackpos = 0;
 }
 
 void setfullscreen(Client *c, int fullscreen)
 {
     DBG("+setfullscreen %lu %d\n", c->win, fullscreen);
-    XWindowChanges wc;
 
     if (fullscreen && !c->isfullscreen)
     {
-        XChangeProperty(gwm.dpy, c->win, gwm.netatom[NetWMState], XA_ATOM, 32, PropModeReplace, (unsigned char*)&gwm.netatom[NetWMFullscreen], 1);
         c->isfullscreen = 1;
         c->dirty_resize = True;
         c->oldstate = c->isfloating;
         c->oldbw = c->bw;
         c->bw = 0;
         c->isfloating = 1;
+        if (ISVISIBLE(c))
+            c->mon->tileddirty = 1;
         resizeclient(c, c->mon->mx, c->mon->my, c->mon->mw, c->mon->mh);
-        wc.stack_mode = Above;
-        wc.border_width = c->bw;
-        wc.sibling = gwm.floating_stack_helper;
-        XConfigureWindow(gwm.dpy, c->win, CWSibling|CWStackMode|CWBorderWidth, &wc);
+        raiseclient(c);
         // no need to arrange, fullscreen window is above everything anyway
     }
     else if (!fullscreen && c->isfullscreen)
     {
-        XChangeProperty(gwm.dpy, c->win, gwm.netatom[NetWMState], XA_ATOM, 32, PropModeReplace, (unsigned char*)0, 0);
         c->isfullscreen = 0;
         c->isfloating = c->oldstate;
+        if (ISVISIBLE(c))
+            c->mon->tileddirty = 1;
         c->bw = c->oldbw;
         c->x = c->oldx;
         c->y = c->oldy;
@@ -295,17 +430,15 @@ void setfloating(Client *c, int floating, int force, int should_arrange)
 {
     DBG("+setfloating %lu %d, %d, %d\n", c->win, floating, force, should_arrange);
 
-    XWindowChanges wc;
-
     // force floating on fixed windows
     floating = c->isfixed ? 1 : floating;
 
     if (floating && (!c->isfloating || force))
     {
         c->isfloating = 1;
-        wc.stack_mode = Above;
-        wc.sibling = gwm.floating_stack_helper;
-        XConfigureWindow(gwm.dpy, c->win, CWSibling|CWStackMode, &wc);
+        if (ISVISIBLE(c))
+            c->mon->tileddirty = 1;
+        raiseclient(c);
 
         if(should_arrange)
         {
@@ -316,9 +449,9 @@ void setfloating(Client *c, int floating, int force, int should_arrange)
     else if (!floating && (c->isfloating || force))
     {
         c->isfloating = 0;
-        wc.stack_mode = Below;
-        wc.sibling = gwm.lowest_barwin;
-        XConfigureWindow(gwm.dpy, c->win, CWSibling|CWStackMode, &wc);
+        if (ISVISIBLE(c))
+            c->mon->tileddirty = 1;
+        raiseclient(c);
 
         if(should_arrange)
             arrange(c->mon);
@@ -329,7 +462,7 @@ void seturgent(Client *c, int urg)
 {
     XWMHints *wmh;
 
-    c->isurgent = urg;
+    setisurgent(c, urg);
     if (!(wmh = XGetWMHints(gwm.dpy, c->win)))
         return;
     wmh->flags = urg ? (wmh->flags | XUrgencyHint) : (wmh->flags & ~XUrgencyHint);
@@ -339,16 +472,24 @@ void seturgent(Client *c, int urg)
 
 void setclientstate(Client *c, long state)
 {
-    long data[] = { state, None };
-    XChangeProperty(gwm.dpy, c->win, gwm.wmatom[WMState], gwm.wmatom[WMState], 32, PropModeReplace, (unsigned char *)data, 2);
+    c->state = state;
+    markdirty(c);
 }
 
 void updatetitle(Client *c)
 {
-    if (!gettextprop(c->win, gwm.netatom[NetWMName], c->name, sizeof(c->name)))
-        gettextprop(c->win, XA_WM_NAME, c->name, sizeof(c->name));
-    if (c->name[0] == '\0') /* hack to mark broken clients */
-        strcpy(c->name, "broken");
+    char name[1024];
+
+    if (!gettextprop(c->win, gwm.netatom[NetWMName], name, sizeof(name)))
+        gettextprop(c->win, XA_WM_NAME, name, sizeof(name));
+    if (name[0] == '\0') /* hack to mark broken clients */
+        strcpy(name, "broken");
+    if (c->name && !strcmp(c->name, name))
+        return;
+    strdrop(c->name);
+    c->name = strstore(name);
+    if (c->devices)
+        titlechanged(c->mon);
 }
 
 /*
@@ -357,8 +498,8 @@ void updatetitle(Client *c)
 int updatewindowtype(Client *c)
 {
     int ret = 0;
-    Atom state = getatomprop(c, gwm.netatom[NetWMState]);
-    Atom wtype = getatomprop(c, gwm.netatom[NetWMWindowType]);
+    Atom state = getatomprop(c->win, gwm.netatom[NetWMState]);
+    Atom wtype = getatomprop(c->win, gwm.netatom[NetWMWindowType]);
 
     if (state == gwm.netatom[NetWMFullscreen])
     {
@@ -366,7 +507,8 @@ int updatewindowtype(Client *c)
         ret = 2;
     }
 
-    if (wtype == gwm.netatom[NetWMWindowTypeDialog])
+    /* utility windows (palettes, toolbars) take input, they float like dialogs */
+    if (wtype == gwm.netatom[NetWMWindowTypeDialog] || wtype == gwm.netatom[NetWMUtility])
     {
         setfloating(c, 1, 0, 1);
         ret = 1;
@@ -492,7 +634,7 @@ void updatewmhints(Client *c)
             wmh->flags &= ~XUrgencyHint;
             XSetWMHints(gwm.dpy, c->win, wmh);
         } else
-            c->isurgent = (wmh->flags & XUrgencyHint) ? 1 : 0;
+            setisurgent(c, (wmh->flags & XUrgencyHint) ? 1 : 0);
         if (wmh->flags & InputHint)
             c->neverfocus = !wmh->input;
         else
@@ -515,16 +657,11 @@ void resize(Client *c, int x, int y, int w, int h, int interact)
 
 void resizeclient(Client *c, int x, int y, int w, int h)
 {
-    XWindowChanges wc;
-
-    c->oldx = c->x; c->x = wc.x = x;
-    c->oldy = c->y; c->y = wc.y = y;
-    c->oldw = c->w; c->w = wc.width = w;
-    c->oldh = c->h; c->h = wc.height = h;
-    wc.border_width = c->bw;
-    XConfigureWindow(gwm.dpy, c->win, CWX|CWY|CWWidth|CWHeight|CWBorderWidth, &wc);
-    configure(c);
-    XSync(gwm.dpy, False);
+    c->oldx = c->x; c->x = x;
+    c->oldy = c->y; c->y = y;
+    c->oldw = c->w; c->w = w;
+    c->oldh = c->h; c->h = h;
+    markdirty(c);
 }
 
 int applysizehints(Client *c, int * __restrict x, int * __restrict y, int * __restrict w, int * __restrict h, int interact)
@@ -4,13 +4,14 @@
 
 extern void manage(Window w, XWindowAttributes *wa);
 extern void unmanage(Client *c, int destroyed);
+extern void unmanagepopup(Client *c, int destroyed);
 
 extern void attach(Client *c);
 extern void append(Client *c);
 extern void detach(Client *c);
+extern void settags(Client *c, Tagset tags);
 extern void attachstack(Client *c);
 extern void detachstack(Client *c);
-extern Client *nexttiled(Client *c);
 
 extern void setfullscreen(Client *c, int fullscreen);
 extern void setfloating(Client *c, int floating, int force, int should_arrange);
@@ -6,6 +6,8 @@
 #include "monitor.h"
 #include "client.h"
 #include "resolvers.h"
+#include "xstate.h"
+#include "resizesync.h"
 
 #include <unistd.h>
 
@@ -19,15 +21,16 @@ void quit(__attribute__((unused)) DevPair *dp, __attribute__((unused)) const Arg
 void reloadconfig(__attribute__((unused)) DevPair *dp, __attribute__((unused)) const Arg *arg)
 {
     load_config();
+    updatetags();
 }
 
 void focusmon(DevPair *dp, const Arg *arg)
 {
     Monitor *m;
 
-    if (!gwm.mons->next)
+    if (!dp->selmon || !gwm.mons->next)
         return;
-    if ((m = dirtomon(dp, arg->i)) == dp->selmon)
+    if (!(m = dirtomon(dp, arg->i)) || m == dp->selmon)
         return;
     
     unfocus(dp, 0);
@@ -39,9 +42,9 @@ void swapmon(DevPair *dp, const Arg *arg)
 {
     Monitor *tarm;
 
-    if (!gwm.mons->next)
+    if (!dp->selmon || !gwm.mons->next)
         return;
-    if ((tarm = dirtomon(dp, arg->i)) == dp->selmon)
+    if (!(tarm = dirtomon(dp, arg->i)) || tarm == dp->selmon)
         return;
     
     Monitor *curm = dp->selmon;
@@ -49,7 +52,7 @@ void swapmon(DevPair *dp, const Arg *arg)
     unfocus(dp, 0);
 
     swap_int(&curm->nmaster, &tarm->nmaster);
-    swap_ulong(&curm->barwin, &tarm->barwin);
+    swapbar(curm, tarm);
     swap_float(&curm->mfact, &tarm->mfact);
     swap_int(&curm->rmaster, &tarm->rmaster);
     swap_int(&curm->num, &tarm->num);
@@ -79,7 +82,7 @@ void swapmon(DevPair *dp, const Arg *arg)
 
 void focusstack(DevPair *dp, const Arg *arg)
 {
-    Client *c = NULL, *i;
+    Client *c;
 
     if (!dp || !dp->sel || !dp->selmon || (dp->sel->isfullscreen && gcfg.lockfullscreen))
         return;
@@ -89,13 +92,9 @@ void focusstack(DevPair *dp, const Arg *arg)
         if (!c)
             for (c = dp->selmon->clients; c && !ISVISIBLE(c); c = c->next);
     } else {
-        for (i = dp->selmon->clients; i != dp->sel; i = i->next)
-            if (ISVISIBLE(i))
-                c = i;
+        for (c = dp->sel->prev; c && !ISVISIBLE(c); c = c->prev);
         if (!c)
-            for (; i; i = i->next)
-                if (ISVISIBLE(i))
-                    c = i;
+            for (c = dp->selmon->clients_end; c && !ISVISIBLE(c); c = c->prev);
     }
 
     if (c) {
@@ -127,7 +126,7 @@ void cyclestack(DevPair *dp, const Arg *arg)
     }
     else
     {
-        for (c = dp->selmon->clients; c->next; c = c->next);
+        c = dp->selmon->clients_end;
         detach(c);
         attach(c);
     }
@@ -141,6 +140,7 @@ void cyclestack(DevPair *dp, const Arg *arg)
 void incnmaster(DevPair *dp, const Arg *arg)
 {
     dp->selmon->nmaster = MAX(dp->selmon->nmaster + arg->i, 0);
+    titlechanged(dp->selmon);
     arrange(dp->selmon);
 }
 
@@ -201,6 +201,12 @@ void movemouse(DevPair *dp, __attribute__((unused)) const Arg *arg)
     dp->move.detail = dp->lastdetail;
     dp->move.ox = c->x;
     dp->move.oy = c->y;
+    dp->move.ow = c->w;
+    dp->move.oh = c->h;
+    dp->move.sx = c->x;
+    dp->move.sy = c->y;
+    dp->move.sw = c->w;
+    dp->move.sh = c->h;
 
     getrootptr(dp, &dp->move.x, &dp->move.y);
 }
@@ -243,14 +249,22 @@ void resizemouse(DevPair *dp, __attribute__((unused)) const Arg *arg)
     if (!dp->resize.c)
     {
         dp->resize.c = dp->sel;
+        dp->resize.edges = 0;
     }
 
     dp->resize.time = dp->lastevent;
     dp->resize.detail = dp->lastdetail;
     dp->resize.ox = c->x;
     dp->resize.oy = c->y;
-    dp->resize.x = c->w + c->bw - 1;
-    dp->resize.x = c->h + c->bw - 1;
+    dp->resize.ow = c->w;
+    dp->resize.oh = c->h;
+    dp->resize.sx = c->x;
+    dp->resize.sy = c->y;
+    dp->resize.sw = c->w;
+    dp->resize.sh = c->h;
+    syncbegin(c);
+
+    getrootptr(dp, &dp->resize.x, &dp->resize.y);
 }
 
 void setlayout(DevPair *dp, const Arg *arg)
@@ -265,9 +279,7 @@ void setlayout(DevPair *dp, const Arg *arg)
     strncpy(dp->selmon->ltsymbol, dp->selmon->lt[dp->selmon->sellt]->symbol, sizeof(dp->selmon->ltsymbol) - 1);
     if (dp->sel)
         arrange(dp->selmon);
-    else
-        drawbar(dp->selmon);
-    drawbar(dp->selmon);
+    markbar(dp->selmon);
 }
 
 /* arg > 1.0 will set mfact absolutely */
@@ -328,19 +340,48 @@ void tag(DevPair *dp, const Arg *arg)
 {
     if (!dp->selmon || !dp->sel)
         return;
-    if (dp->sel && arg->ui & TAGMASK) {
-        dp->sel->tags = arg->ui & TAGMASK;
+    if (dp->sel && arg->t & TAGMASK) {
+        settags(dp->sel, arg->t & TAGMASK);
         focus(dp, NULL);
         arrange(dp->selmon);
     }
 }
 
+/* the single tag dir steps away from the lowest of t, wrapping around gtags */
+static Tagset shifttagset(Tagset t, int dir)
+{
+    int i = (t & TAGMASK) ? __builtin_ctzll(t & TAGMASK) : 0;
+
+    i = ((i + dir) % (int)gtags_len + (int)gtags_len) % (int)gtags_len;
+    return TAGBIT(i);
+}
+
+/* move the focused client to the next (arg->i > 0) or previous tag */
+void shifttag(DevPair *dp, const Arg *arg)
+{
+    if (!dp->sel)
+        return;
+    tag(dp, &(Arg){ .t = shifttagset(dp->sel->tags, arg->i) });
+}
+
+/* view the next (arg->i > 0) or previous tag, reaches those without a key */
+void shiftview(DevPair *dp, const Arg *arg)
+{
+    if (!dp->selmon)
+        return;
+    view(dp, &(Arg){ .t = shifttagset(dp->selmon->tagset[dp->selmon->seltags], arg->i) });
+}
+
 void tagmon(DevPair *dp, const Arg *arg)
 {
+    Monitor *m;
+
     if (!dp->selmon || !dp->sel || !gwm.mons->next)
         return;
+    if (!(m = dirtomon(dp, arg->i)) || m == dp->selmon)
+        return;
 
-    sendmon(dp, dp->sel, dirtomon(dp, arg->i), 1);
+    sendmon(dp, dp->sel, m, 1);
 }
 
 void togglebar(DevPair *dp, __attribute__((unused)) const Arg *arg)
@@ -351,7 +392,7 @@ void togglebar(DevPair *dp, __attribute__((unused)) const Arg *arg)
     updatebarpos(dp->selmon);
     XMoveResizeWindow(gwm.dpy, dp->selmon->barwin, dp->selmon->wx, dp->selmon->by, dp->selmon->ww, gwm.bh);
     arrange(dp->selmon);
-    drawbar(dp->selmon);
+    markbar(dp->selmon);
 }
 
 void togglefloating(DevPair *dp, __attribute__((unused)) const Arg *arg)
@@ -390,7 +431,6 @@ void togglefullscreen(DevPair *dp, __attribute__((unused)) const Arg *arg)
 
 void toggleautoswapmon(DevPair *dp, __attribute__((unused)) const Arg *arg)
 {
-    Clr **cur_scheme;
     Monitor *fake_tar;
     int x, y;
     int cur_bar_offset, tar_bar_offset;
@@ -399,18 +439,12 @@ void toggleautoswapmon(DevPair *dp, __attribute__((unused)) const Arg *arg)
         return;
     
     if(gwm.forcedfocusmon)
-    {
-        cur_scheme = gwm.scheme;
         gwm.forcedfocusmon = NULL;
-    }
     else
-    {
-        cur_scheme = gwm.ff_scheme;
         gwm.forcedfocusmon = dp->selmon;
-    }
 
-    if(dp->sel && updatewindowtype(dp->sel) < 2)
-        XSetWindowBorder(gwm.dpy, dp->sel->win, cur_scheme[CLAMP(SchemeNorm + dp->sel->devices, SchemeNorm, SchemeSel3)][ColBorder].pixel);
+    /* every border switches colour scheme */
+    markalldirty();
     
     if(getrootptr(dp, &x, &y) && (fake_tar = recttomon(dp, x, y, 1, 1)) != dp->selmon)
     {
@@ -433,7 +467,7 @@ void toggleautoswapmon(DevPair *dp, __attribute__((unused)) const Arg *arg)
         XIWarpPointer(gwm.dpy, dp->mptr->info.deviceid, None, None, 0, 0, 0, 0, dp->selmon->wx - fake_tar->wx, (dp->selmon->wy + cur_bar_offset) - (fake_tar->wy + tar_bar_offset));
     }
     
-    drawbar(dp->selmon);
+    markbar(dp->selmon);
 }
 
 void togglermaster(DevPair *dp, __attribute__((unused)) const Arg *arg)
@@ -457,14 +491,14 @@ void togglemouse(DevPair *dp, __attribute__((unused)) const Arg *arg)
 
 void toggletag(DevPair *dp, const Arg *arg)
 {
-    unsigned int newtags;
+    Tagset newtags;
 
     if (!dp->sel || !dp->selmon)
         return;
 
-    newtags = dp->sel->tags ^ (arg->ui & TAGMASK);
+    newtags = dp->sel->tags ^ (arg->t & TAGMASK);
     if (newtags) {
-        dp->sel->tags = newtags;
+        settags(dp->sel, newtags);
         focus(dp, NULL);
         arrange(dp->selmon);
     }
@@ -475,7 +509,7 @@ void toggleview(DevPair *dp, const Arg *arg)
     if (!dp->selmon)
         return;
 
-    unsigned int newtagset = dp->selmon->tagset[dp->selmon->seltags] ^ (arg->ui & TAGMASK);
+    Tagset newtagset = dp->selmon->tagset[dp->selmon->seltags] ^ (arg->t & TAGMASK);
 
     if (newtagset) {
         dp->selmon->tagset[dp->selmon->seltags] = newtagset;
@@ -486,11 +520,11 @@ void toggleview(DevPair *dp, const Arg *arg)
 
 void view(DevPair *dp, const Arg *arg)
 {
-    if ((arg->ui & TAGMASK) == dp->selmon->tagset[dp->selmon->seltags])
+    if ((arg->t & TAGMASK) == dp->selmon->tagset[dp->selmon->seltags])
         return;
     dp->selmon->seltags ^= 1; /* toggle sel tagset */
-    if (arg->ui & TAGMASK)
-        dp->selmon->tagset[dp->selmon->seltags] = arg->ui & TAGMASK;
+    if (arg->t & TAGMASK)
+        dp->selmon->tagset[dp->selmon->seltags] = arg->t & TAGMASK;
     focus(dp, NULL);
     arrange(dp->selmon);
 }
@@ -506,12 +540,17 @@ void pop(DevPair *dp, Client *c)
 void zoom(DevPair *dp, __attribute__((unused)) const Arg *arg)
 {
     Client *c = dp->sel;
+    Monitor *m = dp->selmon;
 
-    if (!c || !dp->selmon ||
-        !dp->selmon->lt[dp->selmon->sellt]->arrange ||
+    if (!c || !m ||
+        !m->lt[m->sellt]->arrange ||
         (dp->sel && dp->sel->isfloating))
         return;
-    if (c == nexttiled(dp->selmon->clients) && !(c = nexttiled(c->next)))
-        return;
+    updatetiled(m);
+    if (m->ntiled && c == m->tiled[0]) {
+        if (m->ntiled < 2)
+            return;
+        c = m->tiled[1];
+    }
     pop(dp, c);
 }
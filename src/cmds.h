@@ -15,6 +15,8 @@ extern void movemouse(DevPair *dp, const Arg *arg);
 extern void resizemouse(DevPair *dp, const Arg *arg);
 extern void setlayout(DevPair *dp, const Arg *arg);
 extern void setmfact(DevPair *dp, const Arg *arg);
+extern void shifttag(DevPair *dp, const Arg *arg);
+extern void shiftview(DevPair *dp, const Arg *arg);
 extern void spawn(DevPair *dp, const Arg *arg);
 extern void tag(DevPair *dp, const Arg *arg);
 extern void tagmon(DevPair *dp, const Arg *arg);
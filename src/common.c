@@ -5,6 +5,9 @@
 #include "devpair.h"
 #include "monitor.h"
 #include "resolvers.h"
+#ifdef COMPOSITOR
+#include "comp.h"
+#endif
 
 #include <execinfo.h>
 
@@ -45,6 +48,10 @@ void print_backtrace(void)
 int xerror(Display *display, XErrorEvent *ee)
 {
     Client *c;
+
+    /* errors of the bar render connection (e.g. a bar window destroyed under it) */
+    if (display != gwm.dpy)
+        return 0;
     // 12, 3, 8
     DBG("xerror: request code=%d, error code=%d, minor code=%d, serial=%lu, resourceid=%lu\n", ee->request_code, ee->error_code, ee->minor_code, ee->serial, ee->resourceid);
     print_backtrace();
@@ -68,8 +75,13 @@ int xerror(Display *display, XErrorEvent *ee)
     || (ee->request_code == X_ConfigureWindow && ee->error_code == BadMatch)
     || (ee->request_code == X_GrabButton && ee->error_code == BadAccess)
     || (ee->request_code == X_GrabKey && ee->error_code == BadAccess)
-    || (ee->request_code == X_CopyArea && ee->error_code == BadDrawable))
+    || (ee->request_code == X_CopyArea && ee->error_code == BadDrawable)
+    || (gwm.syncevent >= 0 && ee->request_code == gwm.syncopcode)) /* counter went away with its client */
+        return 0;
+#ifdef COMPOSITOR
+    if (comperror(ee))
         return 0;
+#endif
     
     fprintf(stderr, "mpwm: fatal error: request code=%d, error code=%d\n",
         ee->request_code, ee->error_code);
@@ -115,14 +127,14 @@ int gettextprop(Window w, Atom atom, char *text, unsigned int size)
     return 1;
 }
 
-Atom getatomprop(Client *c, Atom prop)
+Atom getatomprop(Window w, Atom prop)
 {
     int di;
     unsigned long dl;
     unsigned char *p = NULL;
     Atom da, atom = None;
 
-    if (XGetWindowProperty(gwm.dpy, c->win, prop, 0L, sizeof(atom), False, XA_ATOM,
+    if (XGetWindowProperty(gwm.dpy, w, prop, 0L, sizeof(atom), False, XA_ATOM,
         &da, &di, &dl, &dl, &p) == Success && p) {
         atom = *(Atom *)p;
         XFree(p);
@@ -202,17 +214,22 @@ int updategeom(DevPair *dp)
         /* removed monitors if n > nn */
         for (i = nn; i < n; i++) {
             DBG("removed %d\n", i);
+            m = gwm.mons_end;
             while ((c = m->clients)) {
                 dirty = 1;
-                gwm.mons_end->clients = c->next;
+                detach(c);
                 detachstack(c);
                 c->mon = gwm.mons;
                 attach(c);
                 attachstack(c);
             }
-            if (dp && gwm.mons_end == dp->selmon)
+            if (dp && m == dp->selmon)
                 setselmon(dp, gwm.mons);
-            cleanupmon(gwm.mons_end);
+            /* popups only point at their monitor */
+            for (c = gwm.popups; c; c = c->next)
+                if (c->mon == m)
+                    c->mon = gwm.mons;
+            cleanupmon(m);
         }
 
         free(unique);
@@ -13,6 +13,9 @@
 #include <X11/Xft/Xft.h>
 #include <X11/XF86keysym.h>
 #include <X11/extensions/XInput2.h>
+#include <X11/extensions/sync.h>
+
+#include <stdint.h>
 
 #include <sys/param.h>
 /* macros */
@@ -28,12 +31,18 @@
 #define MOUSEMASK               (BUTTONMASK|PointerMotionMask)
 #define WIDTH(X)                ((X)->w + 2 * (X)->bw)
 #define HEIGHT(X)               ((X)->h + 2 * (X)->bw)
-#define TAGMASK                 ((1 << gtags_len) - 1)
+#define TAGMASK                 (~(Tagset)0 >> (MAXTAGS - gtags_len)) /* 1 <= gtags_len <= MAXTAGS */
+#define TAGBIT(i)               ((Tagset)1 << (i))
 
 #define MAXDEVICES 256 /* from xorg-server/include/misc.h */
+#define MAXTAGS    64  /* bits in a Tagset */
+
+typedef uint64_t Tagset;
 
 typedef XftColor Clr;
 typedef struct Monitor_t Monitor;
+typedef struct BarSlot BarSlot;
+typedef struct BarTitle BarTitle;
 typedef struct Client_t Client;
 typedef struct DevPair_t DevPair;
 typedef struct Device_t Device;
@@ -69,6 +78,17 @@ enum {
     NetClientList,
     NetWMTooltip,
     NetWMPopupMenu,
+    NetWMDropdownMenu,
+    NetWMNotification,
+    NetWMUtility,
+    NetNumberOfDesktops,
+    NetCurrentDesktop,
+    NetDesktopNames,
+    NetWMDesktop,
+    NetWMMoveResize,
+    NetMoveResizeWindow,
+    NetWMSyncRequest,
+    NetWMSyncRequestCounter,
     NetLast
 };
 
@@ -99,45 +119,113 @@ typedef struct {
     void (*arrange)(Monitor*);
 } Layout;
 
+/* edges dragged by an edge-aware resize (_NET_WM_MOVERESIZE) */
+enum {
+    EdgeTop    = 1 << 0,
+    EdgeBottom = 1 << 1,
+    EdgeLeft   = 1 << 2,
+    EdgeRight  = 1 << 3,
+};
+
 typedef struct {
     Client *c;
     Time time;
     int active;
-    int detail;
+    int detail;   /* button that ends the drag, 0 means any button */
+    int edges;    /* 0 resizes the bottom right corner to the pointer */
+    int keyboard; /* started by a keyboard _NET_WM_MOVERESIZE, the keyboard is grabbed */
     int x;
     int y;
-    int ox;
+    int ox;       /* geometry the pointer offsets apply to */
     int oy;
+    int ow;
+    int oh;
+    int sx;       /* geometry when the drag started, restored on cancel */
+    int sy;
+    int sw;
+    int sh;
 } Motion;
 
 typedef struct Client_t {
+    /*
+     * hot: everything a walk over the client lists reads (showhide(),
+     * commit(), the layouts), one cache line on 64-bit
+     */
     Client *next;
     Client *snext;
     Monitor *mon;
+    Window win;
+    Tagset tags;
+    int x, y, w, h;
+    int bw;
+    unsigned char isfloating, isfullscreen, isurgent;
+    unsigned char dirty;  /* pending commit, see xstate.c */
+
+    /* cold */
+    unsigned short devices; /* device pairs focusing it, at most MAXDEVICES */
+    unsigned char isfixed;
+    Client *prev;         /* only read when unlinking, see LISTREMOVE() */
+    Client *sprev;
+    char *name;           /* see strstore() */
     Clr **prev_scheme;
     DevPair *devstack;
-    char name[64];
-    char prefix_name[256];
+    DevPair *devstack_end;
     float mina, maxa;
-    int x, y, w, h;
     int oldx, oldy, oldw, oldh;
     int basew, baseh, incw, inch, maxw, maxh, minw, minh, hintsvalid;
-    int bw, oldbw;
-    unsigned int tags;
+    int oldbw;
     int grabbed;
-    int isfixed, isfloating, isurgent, neverfocus, oldstate, isfullscreen;
+    int neverfocus, oldstate;
+    int counted;          /* included in the tag counters of mon */
     int ismanaged;
-    int devices;
     int dirty_resize;
-    Window win;
+    long netdesktop;      /* last published _NET_WM_DESKTOP, -1 if none */
+    int stackseq;         /* position inside the stacking layer */
+    long order;           /* position in mon->clients, ascending from head to tail */
+    long stackpos;        /* position in mon->stack, 0 while not in it */
+    unsigned long gathered; /* last collected by gather(), see monitor.c */
+    long state;           /* WM_STATE */
+    struct {
+        int x, y, w, h, bw;
+        unsigned long border;
+        long state;
+        int fullscreen;
+    } xs;                 /* last state sent to the server */
+    struct {
+        XSyncCounter counter;
+        XSyncAlarm alarm;
+        int64_t value;    /* last value asked for */
+        int waiting;      /* request sent, not acknowledged yet */
+        Time sent;
+        long sentms;      /* monotonic, for the timeout */
+        int pending, x, y, w, h; /* newest size while waiting */
+        unsigned int nsent, ndropped, ntimeout;
+    } sync;               /* _NET_WM_SYNC_REQUEST, see resizesync.c */
 } Client;
 
+/* bar segments, each one is only redrawn when its content changed */
+enum {
+    SegStatus,
+    SegTags,
+    SegLayout,
+    SegTitle,
+    SegLast
+};
+
+typedef struct {
+    int x, w;
+    uint64_t hash;        /* content and geometry last drawn, 0 forces a redraw */
+} BarSeg;
+
 typedef struct Monitor_t {
     Monitor *next;
     Monitor *prev;
     Client *clients;
+    Client *clients_end;
     Client *stack;
+    Client *stack_end;
     DevPair *devstack;
+    DevPair *devstack_end;
     char ltsymbol[16];
     float mfact;
     int nmaster;
@@ -148,12 +236,32 @@ typedef struct Monitor_t {
     int arranging_clients;
     unsigned int seltags;
     unsigned int sellt;
-    unsigned int tagset[2];
+    Tagset tagset[2];
     int showbar;
     int topbar;
     int rmaster;
     int devices;
     Window barwin;
+    BarSlot *barslot;     /* render state of barwin, see barrender.c */
+    int barinvalid;       /* next snapshot redraws every segment */
+    int bardirty;         /* shows stale state, see flushbars() */
+    long bardrawn;        /* when it was last drawn, ms */
+    BarTitle *bartitle;   /* composed title, see titlechanged() */
+    Monitor *adj[4];      /* neighbours, see dirtomon() */
+    Tagset occ, urg;                   /* tags with clients, urgent clients */
+    unsigned short tagocc[MAXTAGS];    /* clients per tag */
+    unsigned short tagurg[MAXTAGS];    /* urgent clients per tag */
+    Client **tagclients[MAXTAGS];      /* the tagocc[i] clients of each tag, unordered */
+    unsigned int tagclientscap[MAXTAGS];
+    long orderfirst, orderlast;        /* order of the list's head and tail */
+    long stackfirst;                   /* stackpos of the stack's head */
+    Client **visible;     /* visible clients in list order, see updatetiled() */
+    int nvisible, visiblecap;
+    Client **tiled;       /* the tiled ones among them */
+    int ntiled, tiledcap;
+    Tagset tiledtags;                  /* tagset visible was built for */
+    int tileddirty;       /* a visible client was attached, detached, retagged or (un)floated */
+    Tagset shown;                      /* tagset of the last showhide() */
     const Layout *lt[2];
 } Monitor;
 
@@ -161,16 +269,20 @@ typedef struct Device_t {
     DevPair *self;
     XIHierarchyInfo info;
     Device *snext; /* next slave */
-    Device *sprev; /* prev slave (not implemented) */
+    Device *sprev; /* prev slave */
 } Device;
 
 typedef struct DevPair_t {
     DevPair *next;  /* next devpair */
+    DevPair *prev;
     DevPair *fnext; /* next devpair that has same focus */
+    DevPair *fprev;
     DevPair *mnext; /* next devpair that has same monitor */
+    DevPair *mprev;
     Monitor *selmon;
     Monitor *lastselmon;
     Device *slaves;
+    Device *slaves_end;
     Device *mptr;
     Device *mkbd;
     Client *sel;
@@ -178,11 +290,14 @@ typedef struct DevPair_t {
     Motion move;
     Time lastevent;
     int lastdetail;
+    Atom netactive;       /* _MPWM_ACTIVE_WINDOW_<id> */
+    Window netactivewin;  /* last published value of netactive */
 } DevPair;
 
 typedef union {
     int i;
     unsigned int ui;
+    Tagset t;
     float f;
     const void *v;
 } Arg;
@@ -211,6 +326,11 @@ typedef struct Fnt {
     unsigned int h;
     XftFont *xfont;
     FcPattern *pattern;
+#ifdef XRENDER_GLYPHS
+    GlyphSet glyphset;
+    unsigned char *uploaded;       /* bit per glyph index already in glyphset */
+    unsigned int nglyphs;
+#endif
     struct Fnt *next;
 } Fnt;
 
@@ -223,15 +343,85 @@ enum {
     ColBorder3
 }; 
 
+/* measured string width, see drw_fontset_getwidth() */
+#define DRW_WIDTHCACHE 512 /* power of two */
+typedef struct {
+    uint64_t hash;
+    unsigned int gen, len, w;
+} DrwWidth;
+
+/*
+ * codepoint -> font index, one block per 64 codepoints. A slot below
+ * DRW_SLOT_FALLBACK is a font of the configured set, otherwise it is
+ * fallback[slot - DRW_SLOT_FALLBACK].
+ */
+#define DRW_FALLBACKS     16
+#define DRW_BLOCKS        512 /* power of two */
+#define DRW_SLOT_FALLBACK 128
+typedef struct {
+    unsigned int key;              /* (codepoint >> 6) + 1, 0 when unused */
+    uint64_t known;                /* slot[] is valid */
+    uint64_t missing;              /* no font has the codepoint */
+    uint64_t pending;              /* a fallback is being looked up */
+    unsigned char slot[64];
+} DrwBlock;
+
+/* background fallback font lookups, see drw_fallback_async() */
+typedef struct DrwResolver DrwResolver;
+
+#ifdef XRENDER_GLYPHS
+/* requests collected by the glyph set renderer, see drw.c */
+#define DRW_BATCH_RECTS  64
+#define DRW_BATCH_ELTS   64
+#define DRW_BATCH_GLYPHS 1024
+typedef struct {
+    Picture dst;
+    struct {
+        unsigned long pixel;
+        Picture pict;
+    } solid[16];                   /* solid fill sources by pixel */
+    unsigned int nsolid;
+    XRectangle rects[DRW_BATCH_RECTS];
+    int nrects;
+    XRenderColor rectcolor;
+    Picture glyphsrc;
+    XGlyphElt32 elts[DRW_BATCH_ELTS];
+    int nelts;
+    unsigned int glyphs[DRW_BATCH_GLYPHS];
+    int nglyphs;
+    int penx, peny;
+    int x1, y1, x2, y2;            /* extent of the pending glyphs */
+} DrwBatch;
+#endif
+
 typedef struct {
     unsigned int w, h;
     Display *dpy;
     int screen;
     Window root;
     Drawable drawable;
+    Pixmap pixmap;                 /* owned by drw, only if created with a size */
     GC gc;
     Clr *scheme;
     Fnt *fonts;
+    XftDraw *xftdraw;              /* kept across drw_text() calls */
+    unsigned int fontgen;          /* bumped whenever cached widths may be stale */
+    short advance[256];            /* primary font advance + 1, -1 missing, 0 unknown */
+    unsigned int ellipsiswidth, invalidwidth; /* 0 until first measured */
+    DrwWidth widths[DRW_WIDTHCACHE];
+    Fnt *fallback[DRW_FALLBACKS];  /* least recently used one is replaced */
+    unsigned long fallbackuse[DRW_FALLBACKS];
+    unsigned long usetick;
+    DrwBlock blocks[DRW_BLOCKS];
+    unsigned int nblocks;
+    DrwResolver *resolver;         /* NULL: fallbacks are looked up inline */
+    /* optional persistent record of fallback lookups, see drw_fallback_cache() */
+    int (*cachelookup)(long cp, FcPattern **match);
+    void (*cachestore)(long cp, const FcPattern *match);
+    unsigned int placeholders;     /* boxes drawn for pending codepoints */
+#ifdef XRENDER_GLYPHS
+    DrwBatch batch;
+#endif
 } Drw;
 
 typedef struct {
@@ -243,7 +433,10 @@ typedef struct {
 
     Atom wmatom[WMLast];
     Atom netatom[NetLast];
+    Atom utf8string;
     int xi2opcode;
+    int syncopcode;
+    int syncevent;        /* SYNC event base, -1 if unavailable */
     int (*xerrorxlib)(Display *, XErrorEvent *);
 
     Cur *cursor[CurLast];
@@ -257,8 +450,12 @@ typedef struct {
     int sh;               /* X display screen geometry height */
 
     DevPair *devpairs;
+    DevPair *devpairs_end;
     DevPair *spawndev;
 
+    Client *popups;       /* lightweight clients, see managepopup() */
+    Client *popups_end;
+
     Monitor *mons;
     Monitor *mons_end;
     Monitor *spawnmon;
@@ -270,6 +467,15 @@ typedef struct {
     Window highest_barwin;
     Window floating_stack_helper;
 
+    /* declarative X state, see xstate.c */
+    int dirty;
+    int bardirty;         /* some monitor's bar is dirty */
+    int stackdirty;
+    int stacktop;
+    int stackbottom;
+    Window *xstack;       /* last applied stacking order */
+    int nxstack;
+
     /* bar properties (move to a `struct Barwin` in barwin.h eventually)*/
     int bh;               /* bar height */
     int lrpad;            /* sum of left and right padding for text */
@@ -291,5 +497,5 @@ extern int xerrordummy(Display *display, XErrorEvent *ee);
 extern int xerrorstart(Display *display, XErrorEvent *ee);
 
 extern int gettextprop(Window w, Atom atom, char *text, unsigned int size);
-extern Atom getatomprop(Client *c, Atom prop);
+extern Atom getatomprop(Window w, Atom prop);
 extern int updategeom(DevPair *dp);
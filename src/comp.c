@@ -0,0 +1,648 @@
+#include "comp.h"
+#include "resolvers.h"
+#include "util.h"
+
+#include <X11/Xatom.h>
+#include <X11/extensions/Xcomposite.h>
+#include <X11/extensions/Xdamage.h>
+#include <X11/extensions/Xfixes.h>
+#include <X11/extensions/Xrender.h>
+#include <X11/extensions/shape.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * Built-in compositor (cmake -DCOMPOSITOR=ON).
+ *
+ * Every child of the root window is redirected on its own, changes are
+ * reported through DAMAGE and collected into one screen region. compflush()
+ * runs once per event batch and repaints only that region: background and
+ * windows (bottom to top) into an off screen buffer, then the buffer into
+ * the composite overlay window. The overlay takes no input.
+ *
+ * The stacking order is followed from the root's SubstructureNotify events,
+ * so it also covers override-redirect windows the window manager never sees.
+ * A fullscreen client with nothing above it is unredirected and cut out of
+ * the overlay's shape, the server then shows it without a copy.
+ *
+ * A window's named pixmap is kept when it is unmapped, compframe() hands out
+ * the last frame of hidden windows.
+ *
+ * Windows are found by XID through a hash table laid out like the one of
+ * resolvers.c, the list is only walked for the stacking order.
+ */
+
+typedef struct CompWin CompWin;
+struct CompWin {
+    CompWin *next;        /* next window up */
+    CompWin *prev;
+    Window id;
+    int x, y, w, h, bw;
+    int viewable;
+    int inputonly;
+    int argb;             /* has an alpha channel, blended over what is below */
+    int unredirected;     /* fullscreen client the server draws directly */
+    int stale;            /* pixmap does not match the window any more */
+    unsigned int serial;  /* changes with the contents, see compframe() */
+    XRenderPictFormat *format;
+    Damage damage;
+    Pixmap pixmap;        /* named window pixmap, outlives an unmap */
+    Picture picture;
+};
+
+static CompWin *windows;  /* bottom to top */
+static CompWin *topwin;
+static CompWin **table;   /* by id, open addressing, at most half full */
+static unsigned int tablecap, tableused;
+static int active;
+static int compopcode, damageopcode, fixesopcode, damageevent;
+static int renderopcode, rendererror;
+static int sw, sh;
+static Window overlay;
+static Picture target;    /* the overlay */
+static Picture buffer;    /* frame being composed */
+static Picture background;
+static XserverRegion damaged; /* screen area to repaint, None if nothing */
+static int restacked;     /* recheck which fullscreen clients can be unredirected */
+static int reshape;       /* an unredirected window moved or went away */
+static Atom cmatom, rootpmap, setroot;
+
+#define OUTERW(cw) ((cw)->w + 2 * (cw)->bw)
+#define OUTERH(cw) ((cw)->h + 2 * (cw)->bw)
+
+static unsigned int winslot(Window id)
+{
+    return (unsigned int)(((uint64_t)id * 0x9e3779b97f4a7c15ULL) >> 32) & (tablecap - 1);
+}
+
+static CompWin *findwin(Window id)
+{
+    unsigned int i;
+
+    if (!tableused || id == None)
+        return NULL;
+    for (i = winslot(id); table[i]; i = (i + 1) & (tablecap - 1))
+        if (table[i]->id == id)
+            return table[i];
+    return NULL;
+}
+
+static void indexcw(CompWin *cw)
+{
+    CompWin **old = table;
+    unsigned int i, j, oldcap = tablecap;
+
+    if (2 * (tableused + 1) > tablecap) {
+        tablecap = tablecap ? tablecap * 2 : 64;
+        table = ecalloc(tablecap, sizeof(CompWin *));
+        for (i = 0; i < oldcap; i++) {
+            if (!old[i])
+                continue;
+            for (j = winslot(old[i]->id); table[j]; j = (j + 1) & (tablecap - 1));
+            table[j] = old[i];
+        }
+        free(old);
+    }
+    for (i = winslot(cw->id); table[i]; i = (i + 1) & (tablecap - 1));
+    table[i] = cw;
+    tableused++;
+}
+
+static void unindexcw(CompWin *cw)
+{
+    unsigned int i, j, home;
+
+    for (i = winslot(cw->id); table[i] && table[i] != cw; i = (i + 1) & (tablecap - 1));
+    if (!table[i])
+        return;
+    /* move back every entry of the run that would not be found past the hole */
+    for (j = (i + 1) & (tablecap - 1); table[j]; j = (j + 1) & (tablecap - 1)) {
+        home = winslot(table[j]->id);
+        if (((j - home) & (tablecap - 1)) >= ((j - i) & (tablecap - 1))) {
+            table[i] = table[j];
+            i = j;
+        }
+    }
+    table[i] = NULL;
+    tableused--;
+}
+
+/* link cw right above the window below, at the bottom if below is None */
+static void linkabove(CompWin *cw, Window below)
+{
+    CompWin *b = below != None ? findwin(below) : NULL;
+
+    cw->prev = b;
+    cw->next = b ? b->next : windows;
+    if (cw->next)
+        cw->next->prev = cw;
+    else
+        topwin = cw;
+    if (b)
+        b->next = cw;
+    else
+        windows = cw;
+}
+
+static void linktop(CompWin *cw)
+{
+    cw->prev = topwin;
+    cw->next = NULL;
+    if (topwin)
+        topwin->next = cw;
+    else
+        windows = cw;
+    topwin = cw;
+}
+
+static void unlinkwin(CompWin *cw)
+{
+    if (cw->prev)
+        cw->prev->next = cw->next;
+    else
+        windows = cw->next;
+    if (cw->next)
+        cw->next->prev = cw->prev;
+    else
+        topwin = cw->prev;
+    cw->next = cw->prev = NULL;
+}
+
+static void adddamage(XserverRegion r)
+{
+    if (!damaged) {
+        damaged = r;
+        return;
+    }
+    XFixesUnionRegion(gwm.dpy, damaged, damaged, r);
+    XFixesDestroyRegion(gwm.dpy, r);
+}
+
+static void damagerect(int x, int y, int w, int h)
+{
+    XRectangle r = { x, y, w, h };
+
+    adddamage(XFixesCreateRegion(gwm.dpy, &r, 1));
+}
+
+static void damagewin(CompWin *cw)
+{
+    if (cw->viewable && !cw->inputonly)
+        damagerect(cw->x, cw->y, OUTERW(cw), OUTERH(cw));
+}
+
+static void freeframe(CompWin *cw)
+{
+    if (cw->picture)
+        XRenderFreePicture(gwm.dpy, cw->picture);
+    if (cw->pixmap)
+        XFreePixmap(gwm.dpy, cw->pixmap);
+    cw->picture = None;
+    cw->pixmap = None;
+}
+
+/* name the window's current pixmap, the old one is dropped */
+static void fetchframe(CompWin *cw)
+{
+    XRenderPictureAttributes pa = { .subwindow_mode = IncludeInferiors };
+
+    if (cw->picture && !cw->stale)
+        return;
+    freeframe(cw);
+    cw->stale = 0;
+    cw->serial++;
+    if (!(cw->pixmap = XCompositeNameWindowPixmap(gwm.dpy, cw->id)))
+        return;
+    cw->picture = XRenderCreatePicture(gwm.dpy, cw->pixmap, cw->format, CPSubwindowMode, &pa);
+}
+
+static void addwin(Window id)
+{
+    XWindowAttributes wa;
+    CompWin *cw;
+
+    if (id == overlay || findwin(id) || !XGetWindowAttributes(gwm.dpy, id, &wa))
+        return;
+    cw = ecalloc(1, sizeof(CompWin));
+    cw->id = id;
+    cw->x = wa.x;
+    cw->y = wa.y;
+    cw->w = wa.width;
+    cw->h = wa.height;
+    cw->bw = wa.border_width;
+    cw->viewable = wa.map_state == IsViewable;
+    cw->inputonly = wa.class == InputOnly;
+    /* input only windows are only tracked to keep the stacking order */
+    if (!cw->inputonly) {
+        cw->format = XRenderFindVisualFormat(gwm.dpy, wa.visual);
+        cw->argb = cw->format && cw->format->type == PictTypeDirect && cw->format->direct.alphaMask;
+        XCompositeRedirectWindow(gwm.dpy, id, CompositeRedirectManual);
+        cw->damage = XDamageCreate(gwm.dpy, id, XDamageReportNonEmpty);
+    }
+    /* new windows are created on top of their siblings */
+    indexcw(cw);
+    linktop(cw);
+    damagewin(cw);
+    restacked = 1;
+}
+
+/* gone for good or reparented away from the root */
+static void removewin(Window id, int destroyed)
+{
+    CompWin *cw;
+
+    if (!(cw = findwin(id)))
+        return;
+    damagewin(cw);
+    unindexcw(cw);
+    unlinkwin(cw);
+    freeframe(cw);
+    reshape |= cw->unredirected;
+    /* a destroyed window takes its damage object along */
+    if (!destroyed && !cw->inputonly) {
+        XDamageDestroy(gwm.dpy, cw->damage);
+        if (!cw->unredirected)
+            XCompositeUnredirectWindow(gwm.dpy, id, CompositeRedirectManual);
+    }
+    free(cw);
+    restacked = 1;
+}
+
+static void configurewin(XConfigureEvent *ev)
+{
+    CompWin *cw;
+
+    if (!(cw = findwin(ev->window)))
+        return;
+    damagewin(cw);
+    if (ev->width != cw->w || ev->height != cw->h || ev->border_width != cw->bw)
+        cw->stale = 1;
+    reshape |= cw->unredirected;
+    cw->x = ev->x;
+    cw->y = ev->y;
+    cw->w = ev->width;
+    cw->h = ev->height;
+    cw->bw = ev->border_width;
+    unlinkwin(cw);
+    linkabove(cw, ev->above);
+    damagewin(cw);
+    restacked = 1;
+}
+
+static void circulatewin(XCirculateEvent *ev)
+{
+    CompWin *cw;
+
+    if (!(cw = findwin(ev->window)))
+        return;
+    unlinkwin(cw);
+    if (ev->place == PlaceOnTop)
+        linktop(cw);
+    else
+        linkabove(cw, None);
+    damagewin(cw);
+    restacked = 1;
+}
+
+static void mapwin(Window id, int viewable)
+{
+    CompWin *cw;
+
+    if (!(cw = findwin(id)) || cw->viewable == viewable)
+        return;
+    /* the area it leaves shows what is below, the last frame is kept */
+    damagewin(cw);
+    cw->viewable = viewable;
+    if (viewable)
+        cw->stale = 1;
+    damagewin(cw);
+    restacked = 1;
+}
+
+static void damagenotify(XDamageNotifyEvent *ev)
+{
+    XserverRegion parts;
+    CompWin *cw;
+
+    if (!(cw = findwin(ev->drawable)))
+        return;
+    parts = XFixesCreateRegion(gwm.dpy, NULL, 0);
+    XDamageSubtract(gwm.dpy, cw->damage, None, parts);
+    cw->serial++;
+    if (!cw->viewable || cw->unredirected) {
+        XFixesDestroyRegion(gwm.dpy, parts);
+        return;
+    }
+    XFixesTranslateRegion(gwm.dpy, parts, cw->x + cw->bw, cw->y + cw->bw);
+    adddamage(parts);
+}
+
+/* the pixmap set by wallpaper setters, a solid fill without one */
+static Picture rootbackground(void)
+{
+    XRenderPictureAttributes pa = { .repeat = True };
+    XRenderPictFormat *format = XRenderFindVisualFormat(gwm.dpy, DefaultVisual(gwm.dpy, gwm.screen));
+    XRenderColor fill = { 0x2222, 0x2222, 0x2222, 0xffff };
+    Atom props[] = { rootpmap, setroot }, type;
+    unsigned char *data = NULL;
+    unsigned long n, extra;
+    Pixmap pix = None;
+    Picture p;
+    int fmt;
+    size_t i;
+
+    for (i = 0; i < LENGTH(props) && !pix; i++) {
+        if (XGetWindowProperty(gwm.dpy, gwm.root, props[i], 0, 1, False, XA_PIXMAP,
+            &type, &fmt, &n, &extra, &data) == Success && type == XA_PIXMAP && n == 1)
+            pix = *(Pixmap *)data;
+        if (data)
+            XFree(data);
+        data = NULL;
+    }
+    if (pix)
+        return XRenderCreatePicture(gwm.dpy, pix, format, CPRepeat, &pa);
+
+    pix = XCreatePixmap(gwm.dpy, gwm.root, 1, 1, DefaultDepth(gwm.dpy, gwm.screen));
+    p = XRenderCreatePicture(gwm.dpy, pix, format, CPRepeat, &pa);
+    XRenderFillRectangle(gwm.dpy, PictOpSrc, p, &fill, 0, 0, 1, 1);
+    XFreePixmap(gwm.dpy, pix);
+    return p;
+}
+
+static void createbuffer(int w, int h)
+{
+    XRenderPictFormat *format = XRenderFindVisualFormat(gwm.dpy, DefaultVisual(gwm.dpy, gwm.screen));
+    Pixmap pix;
+
+    if (buffer)
+        XRenderFreePicture(gwm.dpy, buffer);
+    sw = w;
+    sh = h;
+    pix = XCreatePixmap(gwm.dpy, gwm.root, sw, sh, DefaultDepth(gwm.dpy, gwm.screen));
+    buffer = XRenderCreatePicture(gwm.dpy, pix, format, 0, NULL);
+    XFreePixmap(gwm.dpy, pix);
+    damagerect(0, 0, sw, sh);
+}
+
+/* a fullscreen client the overlay can leave to the server */
+static int unredirectable(CompWin *cw)
+{
+    CompWin *a;
+    Client *c;
+
+    if (!cw->viewable || cw->inputonly || cw->argb
+    || !(c = wintoclient(cw->id)) || !c->isfullscreen || !ISVISIBLE(c))
+        return 0;
+    /* anything drawn above it would vanish in the overlay's hole */
+    for (a = cw->next; a; a = a->next)
+        if (a->viewable && !a->inputonly
+        && a->x < cw->x + OUTERW(cw) && cw->x < a->x + OUTERW(a)
+        && a->y < cw->y + OUTERH(cw) && cw->y < a->y + OUTERH(a))
+            return 0;
+    return 1;
+}
+
+static void updateunredirected(void)
+{
+    XRectangle screen = { 0, 0, sw, sh }, r;
+    XserverRegion shape, hole;
+    CompWin *cw;
+    int changed = 0, want;
+
+    restacked = 0;
+    for (cw = windows; cw; cw = cw->next) {
+        if ((want = unredirectable(cw)) == cw->unredirected)
+            continue;
+        changed = 1;
+        cw->unredirected = want;
+        DBG("comp: %s %lu\n", want ? "unredirect" : "redirect", cw->id);
+        if (want) {
+            XCompositeUnredirectWindow(gwm.dpy, cw->id, CompositeRedirectManual);
+        } else {
+            XCompositeRedirectWindow(gwm.dpy, cw->id, CompositeRedirectManual);
+            cw->stale = 1;
+            damagewin(cw);
+        }
+    }
+    if (!changed && !reshape)
+        return;
+    reshape = 0;
+    shape = XFixesCreateRegion(gwm.dpy, &screen, 1);
+    for (cw = windows; cw; cw = cw->next) {
+        if (!cw->unredirected)
+            continue;
+        r = (XRectangle){ cw->x, cw->y, OUTERW(cw), OUTERH(cw) };
+        hole = XFixesCreateRegion(gwm.dpy, &r, 1);
+        XFixesSubtractRegion(gwm.dpy, shape, shape, hole);
+        XFixesDestroyRegion(gwm.dpy, hole);
+    }
+    XFixesSetWindowShapeRegion(gwm.dpy, overlay, ShapeBounding, 0, 0, shape);
+    XFixesDestroyRegion(gwm.dpy, shape);
+}
+
+static void paint(void)
+{
+    CompWin *cw;
+
+    if (!background)
+        background = rootbackground();
+    XFixesSetPictureClipRegion(gwm.dpy, buffer, 0, 0, damaged);
+    XRenderComposite(gwm.dpy, PictOpSrc, background, None, buffer, 0, 0, 0, 0, 0, 0, sw, sh);
+    for (cw = windows; cw; cw = cw->next) {
+        if (!cw->viewable || cw->inputonly || cw->unredirected
+        || cw->x >= sw || cw->y >= sh || cw->x + OUTERW(cw) <= 0 || cw->y + OUTERH(cw) <= 0)
+            continue; /* hidden clients live off screen */
+        fetchframe(cw);
+        if (cw->picture)
+            XRenderComposite(gwm.dpy, cw->argb ? PictOpOver : PictOpSrc, cw->picture, None, buffer,
+                0, 0, 0, 0, cw->x, cw->y, OUTERW(cw), OUTERH(cw));
+    }
+    XFixesSetPictureClipRegion(gwm.dpy, target, 0, 0, damaged);
+    XRenderComposite(gwm.dpy, PictOpSrc, buffer, None, target, 0, 0, 0, 0, 0, 0, sw, sh);
+}
+
+void compinit(void)
+{
+    XRenderPictureAttributes pa = { .subwindow_mode = IncludeInferiors };
+    XserverRegion none;
+    Window d1, d2, *wins = NULL;
+    unsigned int i, n;
+    int major = 0, minor = 3, base, err;
+    char name[32];
+
+    if (!XQueryExtension(gwm.dpy, COMPOSITE_NAME, &compopcode, &base, &err)
+    || !XCompositeQueryVersion(gwm.dpy, &major, &minor) || (major == 0 && minor < 3)
+    || !XQueryExtension(gwm.dpy, "DAMAGE", &damageopcode, &damageevent, &err)
+    || !XDamageQueryVersion(gwm.dpy, &(int){1}, &(int){1})
+    || !XQueryExtension(gwm.dpy, "XFIXES", &fixesopcode, &base, &err)
+    || !XFixesQueryVersion(gwm.dpy, &(int){2}, &(int){0})
+    || !XQueryExtension(gwm.dpy, RENDER_NAME, &renderopcode, &base, &err)
+    || !XRenderQueryExtension(gwm.dpy, &base, &rendererror)) {
+        fputs("mpwm: Composite, DAMAGE, XFIXES or RENDER missing, not compositing\n", stderr);
+        return;
+    }
+    snprintf(name, sizeof(name), "_NET_WM_CM_S%d", gwm.screen);
+    cmatom = XInternAtom(gwm.dpy, name, False);
+    if (XGetSelectionOwner(gwm.dpy, cmatom) != None) {
+        fputs("mpwm: another compositing manager is running, not compositing\n", stderr);
+        return;
+    }
+    XSetSelectionOwner(gwm.dpy, cmatom, gwm.wmcheckwin, CurrentTime);
+    rootpmap = XInternAtom(gwm.dpy, "_XROOTPMAP_ID", False);
+    setroot = XInternAtom(gwm.dpy, "_XSETROOT_ID", False);
+
+    overlay = XCompositeGetOverlayWindow(gwm.dpy, gwm.root);
+    none = XFixesCreateRegion(gwm.dpy, NULL, 0);
+    XFixesSetWindowShapeRegion(gwm.dpy, overlay, ShapeInput, 0, 0, none);
+    XFixesDestroyRegion(gwm.dpy, none);
+    target = XRenderCreatePicture(gwm.dpy, overlay,
+        XRenderFindVisualFormat(gwm.dpy, DefaultVisual(gwm.dpy, gwm.screen)), CPSubwindowMode, &pa);
+    createbuffer(gwm.sw, gwm.sh);
+
+    /* nothing may change between listing and redirecting */
+    XGrabServer(gwm.dpy);
+    if (XQueryTree(gwm.dpy, gwm.root, &d1, &d2, &wins, &n)) {
+        for (i = 0; i < n; i++)
+            addwin(wins[i]);
+        if (wins)
+            XFree(wins);
+    }
+    XUngrabServer(gwm.dpy);
+    active = 1;
+}
+
+void compcleanup(void)
+{
+    CompWin *cw;
+
+    if (!active)
+        return;
+    while ((cw = windows))
+        removewin(cw->id, 0);
+    free(table);
+    table = NULL;
+    tablecap = tableused = 0;
+    if (damaged)
+        XFixesDestroyRegion(gwm.dpy, damaged);
+    if (background)
+        XRenderFreePicture(gwm.dpy, background);
+    XRenderFreePicture(gwm.dpy, buffer);
+    XRenderFreePicture(gwm.dpy, target);
+    XCompositeReleaseOverlayWindow(gwm.dpy, gwm.root);
+    XSetSelectionOwner(gwm.dpy, cmatom, None, CurrentTime);
+    damaged = background = buffer = target = None;
+    active = 0;
+}
+
+/* follow the root's children, returns 1 for events only the compositor wants */
+int compevent(XEvent *ev)
+{
+    if (!active)
+        return 0;
+    if (ev->type == damageevent + XDamageNotify) {
+        damagenotify((XDamageNotifyEvent *)ev);
+        return 1;
+    }
+    /* the same events also arrive on client windows and from XSendEvent */
+    if (ev->xany.send_event)
+        return 0;
+    switch (ev->type) {
+    case CreateNotify:
+        if (ev->xcreatewindow.parent == gwm.root)
+            addwin(ev->xcreatewindow.window);
+        break;
+    case DestroyNotify:
+        if (ev->xdestroywindow.event == gwm.root)
+            removewin(ev->xdestroywindow.window, 1);
+        break;
+    case MapNotify:
+        if (ev->xmap.event == gwm.root)
+            mapwin(ev->xmap.window, 1);
+        break;
+    case UnmapNotify:
+        if (ev->xunmap.event == gwm.root)
+            mapwin(ev->xunmap.window, 0);
+        break;
+    case ReparentNotify:
+        if (ev->xreparent.event != gwm.root)
+            break;
+        if (ev->xreparent.parent == gwm.root)
+            addwin(ev->xreparent.window);
+        else
+            removewin(ev->xreparent.window, 0);
+        break;
+    case ConfigureNotify:
+        if (ev->xconfigure.window == gwm.root)
+            createbuffer(ev->xconfigure.width, ev->xconfigure.height);
+        else if (ev->xconfigure.event == gwm.root)
+            configurewin(&ev->xconfigure);
+        break;
+    case CirculateNotify:
+        if (ev->xcirculate.event == gwm.root)
+            circulatewin(&ev->xcirculate);
+        break;
+    case PropertyNotify:
+        if (ev->xproperty.window == gwm.root
+        && (ev->xproperty.atom == rootpmap || ev->xproperty.atom == setroot)) {
+            if (background)
+                XRenderFreePicture(gwm.dpy, background);
+            background = None;
+            damagerect(0, 0, sw, sh);
+        }
+        break;
+    }
+    return 0;
+}
+
+/* repaint what was damaged since the last batch */
+void compflush(void)
+{
+    if (!active)
+        return;
+    if (restacked)
+        updateunredirected();
+    if (!damaged)
+        return;
+    paint();
+    XFixesDestroyRegion(gwm.dpy, damaged);
+    damaged = None;
+}
+
+/*
+ * errors about windows and pixmaps that went away while being composited. A
+ * window destroyed before its DestroyNotify was handled leaves a dead pixmap
+ * name behind, the pictures made from it fail in RENDER.
+ */
+int comperror(XErrorEvent *ee)
+{
+    if (!active)
+        return 0;
+    if (ee->request_code == renderopcode)
+        return ee->error_code == BadDrawable || ee->error_code == BadPixmap
+            || ee->error_code == BadMatch || ee->error_code == rendererror + BadPicture;
+    return ee->request_code == compopcode || ee->request_code == damageopcode
+        || ee->request_code == fixesopcode;
+}
+
+int compactive(void)
+{
+    return active;
+}
+
+/*
+ * contents of w, also the last frame of an unmapped or hidden window,
+ * None if there is none. serial changes whenever the contents do.
+ */
+Picture compframe(Window w, int *width, int *height, unsigned int *serial)
+{
+    CompWin *cw;
+
+    if (!active || !(cw = findwin(w)) || cw->inputonly)
+        return None;
+    if (cw->viewable && !cw->unredirected)
+        fetchframe(cw);
+    *width = OUTERW(cw);
+    *height = OUTERH(cw);
+    *serial = cw->serial;
+    return cw->picture;
+}
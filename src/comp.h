@@ -0,0 +1,11 @@
+#pragma once
+
+#include "common.h"
+
+extern void compinit(void);
+extern void compcleanup(void);
+extern int compevent(XEvent *ev);
+extern void compflush(void);
+extern int comperror(XErrorEvent *ee);
+extern int compactive(void);
+extern Picture compframe(Window w, int *width, int *height, unsigned int *serial);
@@ -3,6 +3,9 @@
 #include "util.h"
 #include "cmds.h"
 #include "layouts.h"
+#ifdef COMPOSITOR
+#include "overview.h"
+#endif
 
 #include <json-c/json.h>
 #include <json-c/json_object.h>
@@ -17,7 +20,8 @@ Config gcfg = {
     .lockfullscreen = 1,
     .gappx = 0,
     .bhgappx = 2,
-    .borderpx = 2
+    .borderpx = 2,
+    .barmaxfps = 0
 };
 
 const char dmenufont[] = "monospace:size=10";
@@ -25,11 +29,12 @@ char dmenumon[2] = "0"; /* component of dmenucmd, manipulated in spawn() */
 const char *dmenucmd[] = { "dmenu_run", "-m", dmenumon, "-fn", dmenufont, "-nb", col_gray1, "-nf", col_gray3, "-sb", col_cyan, "-sf", col_gray4, NULL };
 const char *termcmd[]  = { "alacritty", NULL };
 
-const char *gtags[] = { "1", "2", "3", "4", "5", "6", "7", "8", "9" };
-unsigned int gtags_len = LENGTH(gtags);
+static const char *deftags[] = { "1", "2", "3", "4", "5", "6", "7", "8", "9" };
+const char **gtags = deftags;
+unsigned int gtags_len = LENGTH(deftags);
 
-/* compile-time check if all tags fit into an unsigned int bit array. */
-struct NumTags { char limitexceeded[LENGTH(gtags) > 31 ? -1 : 1]; };
+/* compile-time check if all tags fit into a Tagset. */
+struct NumTags { char limitexceeded[LENGTH(deftags) > MAXTAGS ? -1 : 1]; };
 
 const Key gkeys[] = {
     /* modifier                     key        function        argument */
@@ -52,16 +57,25 @@ const Key gkeys[] = {
     { MODKEY,                       XK_m,      setlayout,         {.v = &glayouts[2]} },
     { MODKEY,                       XK_o,      setlayout,         {.v = &glayouts[3]} },
     { MODKEY|ShiftMask,             XK_space,  togglefloating,    {0} },
+#ifdef COMPOSITOR
+    { MODKEY,                       XK_e,      toggleoverview,    {0} },
+#endif
     { MODKEY|ShiftMask,             XK_f,      togglefullscreen,  {0} },
     { MODKEY|ShiftMask,             XK_s,      toggleautoswapmon, {0} },
-    { MODKEY,                       XK_0,      view,              {.ui = ~0 } },
-    { MODKEY|ShiftMask,             XK_0,      tag,               {.ui = ~0 } },
-    { MODKEY,                       XK_9,      view,              {.ui = 0 } },
-    { MODKEY|ShiftMask,             XK_9,      tag,               {.ui = 0 } },
+    { MODKEY,                       XK_0,      view,              {.t = ~(Tagset)0 } },
+    { MODKEY|ShiftMask,             XK_0,      tag,               {.t = ~(Tagset)0 } },
+    { MODKEY,                       XK_9,      view,              {.t = 0 } },
+    { MODKEY|ShiftMask,             XK_9,      tag,               {.t = 0 } },
+    { MODKEY,                       XK_bracketright, shiftview,   {.i = +1 } },
+    { MODKEY,                       XK_bracketleft,  shiftview,   {.i = -1 } },
+    { MODKEY|ShiftMask,             XK_bracketright, shifttag,    {.i = +1 } },
+    { MODKEY|ShiftMask,             XK_bracketleft,  shifttag,    {.i = -1 } },
     { MODKEY,                       XK_Tab,    cyclestack,        {.i = +1 } },
     { MODKEY|ShiftMask,             XK_Tab,    cyclestack,        {.i = -1 } },
     { MODKEY,                       XK_comma,  focusmon,          {.i = +1 } },
     { MODKEY,                       XK_period, focusmon,          {.i = -1 } },
+    { MODKEY|ControlMask,           XK_comma,  focusmon,          {.i = +2 } },
+    { MODKEY|ControlMask,           XK_period, focusmon,          {.i = -2 } },
     { MODKEY|ShiftMask,             XK_comma,  tagmon,            {.i = +1 } },
     { MODKEY|ShiftMask,             XK_period, tagmon,            {.i = -1 } },
     { MODKEY|ShiftMask|ControlMask, XK_comma,  swapmon,           {.i = +1 } },
@@ -194,6 +208,29 @@ void read_json_int(const char* outer_key, const char *inner_key, int *out, int d
         *out = json_object_get_int(inner_jobj);
 }
 
+void read_json_int64(const char* outer_key, const char *inner_key, int64_t *out, int64_t default_value, struct json_object *outer_jobj)
+{
+    if(out)
+        *out = default_value;
+
+    struct json_object *inner_jobj = NULL;
+    if (!outer_jobj)
+        return;
+
+    inner_jobj = json_object_object_get(outer_jobj, inner_key);
+    if (!inner_jobj)
+        return;
+
+    if(json_object_get_type(inner_jobj) != json_type_int)
+    {
+        fprintf(stderr, "[%s.%s] expected integer type\n", outer_key, inner_key);
+        return;
+    }
+
+    if(out)
+        *out = json_object_get_int64(inner_jobj);
+}
+
 void read_json_boolean(const char* outer_key, const char *inner_key, int *out, int default_value, struct json_object *outer_jobj)
 {
     if(out)
@@ -226,7 +263,7 @@ Rule *parse_rule(const char *key, struct json_object *jrule)
     read_json_string(key, "class", &r->class, NULL, jrule);
     read_json_string(key, "instance", &r->instance, NULL, jrule);
     read_json_string(key, "title", &r->title, NULL, jrule);
-    read_json_int(key, "tags", (int*)&r->tags, 0, jrule);
+    read_json_int64(key, "tags", (int64_t*)&r->tags, 0, jrule);
     read_json_boolean(key, "isfloating", &r->isfloating, 0, jrule);
     read_json_boolean(key, "isfullscreen", &r->isfullscreen, 0, jrule);
     read_json_int(key, "monitor", &r->monitor, -1, jrule);
@@ -283,6 +320,63 @@ void load_rules_config(struct json_object *jcfg)
     gcfg.rules = new_rule_head;
 }
 
+void unload_tags(void)
+{
+    unsigned int i;
+
+    if(gtags == deftags)
+        return;
+
+    for(i = 0; i < gtags_len; i++)
+        free((char *)gtags[i]);
+    free(gtags);
+
+    gtags = deftags;
+    gtags_len = LENGTH(deftags);
+}
+
+/* "tags": ["web", "dev", ...], 1 to MAXTAGS names, the defaults without it */
+void load_tags_config(struct json_object *jcfg)
+{
+    struct json_object *tags_obj, *tag_obj;
+    const char **tags;
+    size_t i, n;
+
+    tags_obj = json_object_object_get(jcfg, "tags");
+    if(!tags_obj)
+    {
+        unload_tags();
+        return;
+    }
+
+    if(json_object_get_type(tags_obj) != json_type_array
+    || !(n = json_object_array_length(tags_obj)) || n > MAXTAGS)
+    {
+        fprintf(stderr, "[config.tags] expected an array of 1 to %d names\n", MAXTAGS);
+        return;
+    }
+
+    tags = ecalloc(n, sizeof(char *));
+    for(i = 0; i < n; i++)
+    {
+        tag_obj = json_object_array_get_idx(tags_obj, i);
+        if(json_object_get_type(tag_obj) != json_type_string)
+        {
+            // keep the old tags
+            fprintf(stderr, "[config.tags] expected string type\n");
+            while(i--)
+                free((char *)tags[i]);
+            free(tags);
+            return;
+        }
+        tags[i] = strdup(json_object_get_string(tag_obj));
+    }
+
+    unload_tags();
+    gtags = tags;
+    gtags_len = n;
+}
+
 void load_config(void)
 {
     DBG("loading config!\n");
@@ -306,6 +400,8 @@ void load_config(void)
     }
 
     load_rules_config(jcfg);
+    load_tags_config(jcfg);
+    read_json_int("config", "barmaxfps", &gcfg.barmaxfps, 0, jcfg);
 
     json_object_put(jcfg);
 }
@@ -313,4 +409,5 @@ void load_config(void)
 void unload_config(void)
 {
     unload_rules(&gcfg.rules);
+    unload_tags();
 }
\ No newline at end of file
@@ -5,10 +5,10 @@
 /* key definitions */
 #define MODKEY Mod1Mask
 #define TAGKEYS(KEY,TAG) \
-    { MODKEY,                       KEY,      view,           {.ui = 1 << TAG} }, \
-    { MODKEY|ControlMask,           KEY,      toggleview,     {.ui = 1 << TAG} }, \
-    { MODKEY|ShiftMask,             KEY,      tag,            {.ui = 1 << TAG} }, \
-    { MODKEY|ControlMask|ShiftMask, KEY,      toggletag,      {.ui = 1 << TAG} },
+    { MODKEY,                       KEY,      view,           {.t = TAGBIT(TAG)} }, \
+    { MODKEY|ControlMask,           KEY,      toggleview,     {.t = TAGBIT(TAG)} }, \
+    { MODKEY|ShiftMask,             KEY,      tag,            {.t = TAGBIT(TAG)} }, \
+    { MODKEY|ControlMask|ShiftMask, KEY,      toggletag,      {.t = TAGBIT(TAG)} },
 
 typedef struct Rule_t Rule;
 
@@ -17,7 +17,7 @@ typedef struct Rule_t {
 	char *class;
 	char *instance;
 	char *title;
-	unsigned int tags;
+	Tagset tags;
 	int isfloating;
     int isfullscreen;
 	int monitor;
@@ -32,6 +32,7 @@ typedef struct {
     int gappx;                 /* gap amount in pixels between clients */
     int bhgappx;               /* gap between top bar and clients */
     unsigned int borderpx;     /* border pixel of windows */
+    int barmaxfps;             /* redraws per second and bar, 0 means no limit */
 
     Rule *rules;
 } Config;
@@ -55,7 +56,7 @@ static const char col_ff_green[]    = "#33AA22";
 static const char col_ff_red[]      = "#AA1111";
 
 /* tagging */
-extern const char *gtags[];
+extern const char **gtags;    /* default names or the "tags" of the config file */
 extern unsigned int gtags_len;
 
 /* layout(s) */
@@ -6,6 +6,9 @@
 #include "client.h"
 #include "events.h"
 #include "resolvers.h"
+#include "ewmh.h"
+#include "xstate.h"
+#include "slab.h"
 
 Device deviceslots[MAXDEVICES] = {0};
 
@@ -15,7 +18,6 @@ void initdevices(void)
     int32_t idx;
     XIDeviceInfo *devs;
     DevPair *dp;
-    Device *d;
     Monitor *m;
     int x, y;
 
@@ -51,14 +53,7 @@ void initdevices(void)
             continue;
         if (!(dp = getdevpair(deviceslots[i].info.attachment)))
             die("could not find device pair for slave device\n");
-        if (!dp->slaves) {
-            d = &deviceslots[i];
-            dp->slaves = d;
-        } else {
-            for (d = dp->slaves; d && d->snext; d = d->snext);
-            d->snext = &deviceslots[i];
-        }
-        deviceslots[i].self = dp;
+        attachslave(dp, &deviceslots[i]);
     }
 
     /* initialize device pairs */
@@ -73,17 +68,14 @@ void initdevices(void)
     XIFreeDeviceInfo(devs);
 }
 
+static SlabPool devpairpool = SLABPOOL(DevPair);
+
 DevPair *createdevpair(void)
 {
-    DevPair *last_dp;
     DevPair *dp;
 
-    dp = ecalloc(1, sizeof(DevPair));
-    for (last_dp = gwm.devpairs; last_dp && last_dp->next; last_dp = last_dp->next);
-    if (last_dp)
-        last_dp->next = dp;
-    else
-        gwm.devpairs = dp;
+    dp = slaballoc(&devpairpool);
+    LISTAPPEND(gwm.devpairs, gwm.devpairs_end, dp, next, prev);
     return dp;
 }
 
@@ -94,16 +86,25 @@ DevPair *getdevpair(int deviceid)
 
 void removedevpair(DevPair *dp)
 {
-    DevPair **pdp;
-
     setsel(dp, NULL);
     setselmon(dp, NULL);
+    ewmhremovedevpair(dp);
 
-    /* pop devpair from devpairs */
-    for (pdp = &gwm.devpairs; *pdp && *pdp != dp; pdp = &(*pdp)->next);
-    *pdp = dp->next;
+    LISTREMOVE(gwm.devpairs, gwm.devpairs_end, dp, next, prev);
 
-    free(dp);
+    slabfree(&devpairpool, dp);
+}
+
+void attachslave(DevPair *dp, Device *d)
+{
+    LISTAPPEND(dp->slaves, dp->slaves_end, d, snext, sprev);
+    d->self = dp;
+}
+
+void detachslave(Device *d)
+{
+    LISTREMOVE(d->self->slaves, d->self->slaves_end, d, snext, sprev);
+    d->self = NULL;
 }
 
 void updatedevpair(DevPair *dp)
@@ -239,69 +240,27 @@ void grabkeys(void)
         grabdevicekeys(dp->mkbd);
 }
 
-void format_client_prefix_name(Client *c)
-{
-    DevPair *dp;
-    int ri = 0, fi = 0;
-    int i;
-
-    if ((ri = snprintf(&c->prefix_name[fi], sizeof(c->prefix_name) - fi, "[")) < 0)
-        return;
-    fi += ri;
-    for (dp = c->devstack, i = 0; dp; dp = dp->fnext, i++) {
-        if(!i) {
-            if ((ri = snprintf(&c->prefix_name[fi], sizeof(c->prefix_name) - fi, "%d", dp->mptr->info.deviceid)) < 0)
-                return;
-        }
-        else {
-            if ((ri = snprintf(&c->prefix_name[fi], sizeof(c->prefix_name) - fi, ", %d", dp->mptr->info.deviceid)) < 0)
-                return;
-        }
-
-        fi += ri;
-    }
-
-    snprintf(&c->prefix_name[fi], sizeof(c->prefix_name) - fi, "]");
-}
-
 void setsel(DevPair *dp, Client *c)
 {
-    DevPair **tdp;
-    DevPair *ndp;
-    Clr **cur_scheme;
-
     if (dp->sel == c)
         return;
 
     DBG("+setsel %lu -> %lu\n", dp->sel ? dp->sel->win : 0, c ? c->win : 0);
 
-    if(gwm.forcedfocusmon)
-        cur_scheme = gwm.ff_scheme;
-    else
-        cur_scheme = gwm.scheme;
-    
     if (dp->sel) {
         dp->sel->devices--;
-        if(updatewindowtype(dp->sel) < 2)
-            XSetWindowBorder(gwm.dpy, dp->sel->win, cur_scheme[CLAMP(SchemeNorm + dp->sel->devices, SchemeNorm, SchemeSel3)][ColBorder].pixel);
-        for (tdp = &dp->sel->devstack; *tdp && *tdp != dp; tdp = &(*tdp)->fnext);
-        *tdp = dp->fnext;
-        dp->fnext = NULL;
-        format_client_prefix_name(dp->sel);
+        markdirty(dp->sel); /* border colour follows the device count */
+        LISTREMOVE(dp->sel->devstack, dp->sel->devstack_end, dp, fnext, fprev);
+        titlechanged(dp->sel->mon);
     }
     
     dp->sel = c;
 
     if (dp->sel) {
         dp->sel->devices++;
-        if(updatewindowtype(dp->sel) < 2)
-            XSetWindowBorder(gwm.dpy, dp->sel->win, cur_scheme[CLAMP(SchemeNorm + dp->sel->devices, SchemeNorm, SchemeSel3)][ColBorder].pixel);
-        for (ndp = dp->sel->devstack; ndp && ndp->fnext; ndp = ndp->fnext);
-        if (ndp)
-            ndp->fnext = dp;
-        else
-            dp->sel->devstack = dp;
-        format_client_prefix_name(dp->sel);
+        markdirty(dp->sel);
+        LISTAPPEND(dp->sel->devstack, dp->sel->devstack_end, dp, fnext, fprev);
+        titlechanged(dp->sel->mon);
     }
     DBG("-setsel\n");
 }
@@ -309,8 +268,6 @@ void setsel(DevPair *dp, Client *c)
 void setselmon(DevPair *dp, Monitor *m)
 {
     DBG("+setselmon\n");
-    DevPair **tdp;
-    DevPair *ndp;
     XEvent ev;
     int cur_bar_offset;
     int tar_bar_offset;
@@ -331,7 +288,8 @@ void setselmon(DevPair *dp, Monitor *m)
 
         Monitor *cur = dp->selmon;
         int dir = (cur->mx + (cur->mw / 2)) - (tar->mx + (tar->mw / 2));
-        tar2 = dirtomon(dp, -dir);
+        if ((tar2 = dirtomon(dp, dir < 0 ? 1 : -1)) == cur)
+            tar2 = NULL;
         
         if(getrootptr(dp, &x, &y) && (recttomon(dp, x, y, 1, 1) != cur || dp->move.c))
         {
@@ -359,7 +317,7 @@ void setselmon(DevPair *dp, Monitor *m)
         XSync(gwm.dpy, False);
         
         swap_int(&cur->nmaster, &tar->nmaster);
-        swap_ulong(&cur->barwin, &tar->barwin);
+        swapbar(cur, tar);
         swap_float(&cur->mfact, &tar->mfact);
         swap_int(&cur->rmaster, &tar->rmaster);
         swap_int(&cur->num, &tar->num);
@@ -375,7 +333,7 @@ void setselmon(DevPair *dp, Monitor *m)
         if(tar2)
         {
             swap_int(&cur->nmaster, &tar->nmaster);
-            swap_ulong(&cur->barwin, &tar2->barwin);
+            swapbar(cur, tar2);
             swap_float(&cur->mfact, &tar->mfact);
             swap_int(&cur->rmaster, &tar->rmaster);
             swap_int(&cur->num, &tar2->num);
@@ -406,20 +364,14 @@ void setselmon(DevPair *dp, Monitor *m)
 
     if (dp->selmon) {
         dp->selmon->devices--;
-        for (tdp = &dp->selmon->devstack; *tdp && *tdp != dp; tdp = &(*tdp)->mnext);
-        *tdp = dp->mnext;
-        dp->mnext = NULL;
+        LISTREMOVE(dp->selmon->devstack, dp->selmon->devstack_end, dp, mnext, mprev);
     }
 
     dp->lastselmon = dp->selmon;
     dp->selmon = m;
 
     if (dp->selmon) {
-        for (ndp = dp->selmon->devstack; ndp && ndp->mnext; ndp = ndp->mnext);
-        if (ndp)
-            ndp->mnext = dp;
-        else
-            dp->selmon->devstack = dp;
+        LISTAPPEND(dp->selmon->devstack, dp->selmon->devstack_end, dp, mnext, mprev);
         dp->selmon->devices++;
     }
 
@@ -431,7 +383,7 @@ void setselmon(DevPair *dp, Monitor *m)
         gwm.forcing_focus = 0;
     }
     
-    drawbars();
+    markbars();
 }
 
 void focus(DevPair *dp, Client *c)
@@ -443,7 +395,7 @@ void focus(DevPair *dp, Client *c)
         return;
 
     if ((!c || !ISVISIBLE(c)) && dp->selmon)
-        for (c = dp->selmon->stack; c && !ISVISIBLE(c); c = c->snext);
+        c = topvisible(dp->selmon);
 
     if (dp->sel && dp->sel != c)
         unfocus(dp, 0);
@@ -463,7 +415,6 @@ void focus(DevPair *dp, Client *c)
     } else {
         XISetFocus(gwm.dpy, dp->mkbd->info.deviceid, gwm.root, CurrentTime);
         XISetClientPointer(gwm.dpy, None, dp->mptr->info.deviceid);
-        XDeleteProperty(gwm.dpy, gwm.root, gwm.netatom[NetActiveWindow]);
     }
 
     setsel(dp, c);
@@ -477,7 +428,7 @@ void focus(DevPair *dp, Client *c)
         grabbuttons(ndp->mptr, c, 1);
         setfocus(ndp, c);
     }
-	drawbars();
+	markbars();
     DBG("-focus\n");
 }
 
@@ -487,7 +438,6 @@ void focus(DevPair *dp, Client *c)
 */
 void unfocus(DevPair *dp, int setfocus)
 {
-    XWindowChanges wc;
     DBG("+unfocus %lu\n", dp->sel ? dp->sel->win : 0);
     
     if (!dp || !dp->sel)
@@ -496,35 +446,23 @@ void unfocus(DevPair *dp, int setfocus)
     grabbuttons(dp->mptr, dp->sel, 0);
     
     if(dp->sel->isfloating)
-    {
-        wc.stack_mode = Below;
-        wc.sibling = gwm.floating_stack_helper;
-        XConfigureWindow(gwm.dpy, dp->sel->win, CWSibling|CWStackMode, &wc);   
-    }
+        lowerclient(dp->sel);
 
     if (setfocus) {
         XISetFocus(gwm.dpy, dp->mkbd->info.deviceid, gwm.root, CurrentTime);
         XISetClientPointer(gwm.dpy, None, dp->mptr->info.deviceid);
-        XDeleteProperty(gwm.dpy, gwm.root, gwm.netatom[NetActiveWindow]);
     }
 }
 
 void setfocus(DevPair *dp, Client *c)
 {
-    XWindowChanges wc;
-
     if (!c->neverfocus) {
         XISetFocus(gwm.dpy, dp->mkbd->info.deviceid, c->win, CurrentTime);
         XISetClientPointer(gwm.dpy, c->win, dp->mptr->info.deviceid);
-        XChangeProperty(gwm.dpy, gwm.root, gwm.netatom[NetActiveWindow], XA_WINDOW, 32, PropModeReplace, (unsigned char *) &(c->win), 1);
 
         // make sure focused window goes over other floating windows
         if(c->isfloating)
-        {
-            wc.stack_mode = Above;
-            wc.sibling = gwm.floating_stack_helper;
-            XConfigureWindow(gwm.dpy, c->win, CWSibling|CWStackMode, &wc);
-        }
+            raiseclient(c);
     }
     sendevent(c, gwm.wmatom[WMTakeFocus]);
 }
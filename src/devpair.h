@@ -7,6 +7,8 @@ extern DevPair *createdevpair(void);
 extern DevPair *getdevpair(int deviceid);
 extern void removedevpair(DevPair *dp);
 extern void updatedevpair(DevPair *dp);
+extern void attachslave(DevPair *dp, Device *d);
+extern void detachslave(Device *d);
 extern int getrootptr(DevPair *dp, int *x, int *y);
 
 extern void grabkeys(void);
@@ -1,8 +1,13 @@
 /* See LICENSE file for copyright and license details. */
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
 #include "drw.h"
 #include "util.h"
 
@@ -10,6 +15,60 @@
 
 Drw *gdrw = NULL;
 
+static void xfont_free(Fnt *font);
+static void fallback_forget(DrwResolver *res);
+static void fallback_stop(Drw *drw);
+#ifdef XRENDER_GLYPHS
+static void batch_flush(Drw *drw);
+#endif
+
+/* every cached width, advance and fallback is relative to the current font set */
+static void
+fontset_changed(Drw *drw)
+{
+	int i;
+
+	if (drw->resolver)
+		fallback_forget(drw->resolver);
+	drw->fontgen++;
+	memset(drw->advance, 0, sizeof(drw->advance));
+	drw->ellipsiswidth = drw->invalidwidth = 0;
+#ifdef XRENDER_GLYPHS
+	/* queued glyphs reference the glyph sets of the fonts freed below */
+	batch_flush(drw);
+#endif
+	for (i = 0; i < DRW_FALLBACKS; i++) {
+		xfont_free(drw->fallback[i]);
+		drw->fallback[i] = NULL;
+	}
+	memset(drw->blocks, 0, sizeof(drw->blocks));
+	drw->nblocks = 0;
+}
+
+
+/* number of leading ASCII bytes in s[0..n) */
+static size_t
+ascii_prefix(const char *s, size_t n)
+{
+	size_t i = 0;
+#if defined(__AVX2__)
+	for (; i + 32 <= n; i += 32) {
+		unsigned int m = _mm256_movemask_epi8(_mm256_loadu_si256((const __m256i *)(s + i)));
+		if (m)
+			return i + __builtin_ctz(m);
+	}
+#endif
+#if defined(__SSE2__)
+	for (; i + 16 <= n; i += 16) {
+		unsigned int m = _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)(s + i)));
+		if (m)
+			return i + __builtin_ctz(m);
+	}
+#endif
+	for (; i < n && !(s[i] & 0x80); i++);
+	return i;
+}
+
 static int
 utf8decode(const char *s_in, long *u, int *err)
 {
@@ -25,7 +84,15 @@ utf8decode(const char *s_in, long *u, int *err)
 	static const unsigned int overlong[] = { 0x0, 0x80, 0x0800, 0x10000 };
 
 	const unsigned char *s = (const unsigned char *)s_in;
-	int len = lens[*s >> 3];
+	int len;
+
+	if (*s < 0x80) {
+		*u = *s;
+		*err = 0;
+		return 1;
+	}
+
+	len = lens[*s >> 3];
 	*u = UTF_INVALID;
 	*err = 1;
 	if (len == 0)
@@ -46,6 +113,179 @@ utf8decode(const char *s_in, long *u, int *err)
 	return len;
 }
 
+#ifdef XRENDER_GLYPHS
+/*
+ * Glyph set renderer: glyphs are rasterised with FreeType once and uploaded
+ * into a GlyphSet per font, text is then drawn with XRenderCompositeText32
+ * from a solid fill picture per colour. Rectangles and text are collected and
+ * only sent when the colour changes, a rectangle covers pending text, a
+ * buffer is full or the drawable is copied, so a bar segment usually costs
+ * one FillRectangles and one CompositeGlyphs request.
+ */
+static void
+batch_flush_rects(Drw *drw)
+{
+	DrwBatch *b = &drw->batch;
+
+	if (b->nrects)
+		XRenderFillRectangles(drw->dpy, PictOpSrc, b->dst, &b->rectcolor, b->rects, b->nrects);
+	b->nrects = 0;
+}
+
+static void
+batch_flush(Drw *drw)
+{
+	DrwBatch *b = &drw->batch;
+
+	batch_flush_rects(drw);
+	if (b->nelts)
+		XRenderCompositeText32(drw->dpy, PictOpOver, b->glyphsrc, b->dst, None,
+		                       0, 0, 0, 0, b->elts, b->nelts);
+	b->nelts = b->nglyphs = 0;
+	b->penx = b->peny = 0;
+}
+
+static Picture
+solid_picture(Drw *drw, Clr *clr)
+{
+	DrwBatch *b = &drw->batch;
+	unsigned int i;
+
+	for (i = 0; i < b->nsolid; i++)
+		if (b->solid[i].pixel == clr->pixel)
+			return b->solid[i].pict;
+	if (b->nsolid == LENGTH(b->solid)) {
+		/* schemes use a handful of colours, start over if that changes,
+		 * queued text still refers to one of them */
+		batch_flush(drw);
+		for (i = 0; i < b->nsolid; i++)
+			XRenderFreePicture(drw->dpy, b->solid[i].pict);
+		b->nsolid = 0;
+	}
+	b->solid[b->nsolid].pixel = clr->pixel;
+	b->solid[b->nsolid].pict = XRenderCreateSolidFill(drw->dpy, &clr->color);
+	return b->solid[b->nsolid++].pict;
+}
+
+static void
+batch_rect(Drw *drw, int x, int y, unsigned int w, unsigned int h, Clr *clr)
+{
+	DrwBatch *b = &drw->batch;
+
+	if (!w || !h)
+		return;
+	/* text already queued below the rectangle has to go out first */
+	if (b->nelts && x < b->x2 && x + (int)w > b->x1 && y < b->y2 && y + (int)h > b->y1)
+		batch_flush(drw);
+	if (b->nrects && (b->nrects == DRW_BATCH_RECTS || memcmp(&b->rectcolor, &clr->color, sizeof(XRenderColor))))
+		batch_flush_rects(drw);
+	b->rectcolor = clr->color;
+	b->rects[b->nrects++] = (XRectangle){ x, y, w, h };
+}
+
+static int
+glyph_upload(Drw *drw, Fnt *font, FT_UInt idx)
+{
+	FT_Face face;
+	FT_Bitmap *bm;
+	XGlyphInfo ext, gi;
+	Glyph gid = idx;
+	unsigned char *buf;
+	unsigned int stride, r, c;
+
+	if (font->uploaded && idx < font->nglyphs && font->uploaded[idx >> 3] & (1 << (idx & 7)))
+		return 1;
+
+	XftGlyphExtents(drw->dpy, font->xfont, &idx, 1, &ext);
+	if (!(face = XftLockFace(font->xfont)))
+		return 0;
+	if (!font->glyphset) {
+		font->glyphset = XRenderCreateGlyphSet(drw->dpy, XRenderFindStandardFormat(drw->dpy, PictStandardA8));
+		font->nglyphs = face->num_glyphs;
+		font->uploaded = ecalloc((font->nglyphs + 7) / 8 + 1, 1);
+	}
+	if (idx >= font->nglyphs || FT_Load_Glyph(face, idx, FT_LOAD_DEFAULT)
+	|| FT_Render_Glyph(face->glyph, FT_RENDER_MODE_NORMAL)) {
+		XftUnlockFace(font->xfont);
+		return 0;
+	}
+
+	bm = &face->glyph->bitmap;
+	gi.width = bm->width;
+	gi.height = bm->rows;
+	gi.x = -face->glyph->bitmap_left;
+	gi.y = face->glyph->bitmap_top;
+	gi.xOff = ext.xOff; /* advance as measured by drw_font_getexts() */
+	gi.yOff = 0;
+
+	/* A8 rows are padded to 4 bytes */
+	stride = (bm->width + 3) & ~3u;
+	buf = ecalloc(stride * bm->rows + 1, 1);
+	for (r = 0; r < bm->rows; r++) {
+		if (bm->pixel_mode == FT_PIXEL_MODE_MONO)
+			for (c = 0; c < bm->width; c++)
+				buf[r * stride + c] = bm->buffer[r * bm->pitch + c / 8] & (0x80 >> (c % 8)) ? 0xff : 0;
+		else
+			memcpy(&buf[r * stride], &bm->buffer[r * bm->pitch], bm->width);
+	}
+	XRenderAddGlyphs(drw->dpy, font->glyphset, &gid, &gi, 1, (char *)buf, stride * bm->rows);
+	free(buf);
+	XftUnlockFace(font->xfont);
+
+	font->uploaded[idx >> 3] |= 1 << (idx & 7);
+	return 1;
+}
+
+static void
+batch_text(Drw *drw, Fnt *font, int x, int y, const char *text, int len, Clr *clr)
+{
+	DrwBatch *b = &drw->batch;
+	Picture src = solid_picture(drw, clr);
+	XGlyphElt32 *elt;
+	XGlyphInfo ext;
+	FT_UInt idx;
+	long cp;
+	int i, n, err, x0 = x;
+
+	if (b->nelts && (b->glyphsrc != src || b->nelts == DRW_BATCH_ELTS || b->nglyphs + len > DRW_BATCH_GLYPHS))
+		batch_flush(drw);
+	b->glyphsrc = src;
+
+	elt = &b->elts[b->nelts];
+	elt->chars = &b->glyphs[b->nglyphs];
+	elt->nchars = 0;
+	elt->xOff = x - b->penx;
+	elt->yOff = y - b->peny;
+	for (i = 0; i < len && b->nglyphs < DRW_BATCH_GLYPHS; i += n) {
+		n = utf8decode(text + i, &cp, &err);
+		idx = XftCharIndex(drw->dpy, font->xfont, cp);
+		if (!glyph_upload(drw, font, idx))
+			continue;
+		XftGlyphExtents(drw->dpy, font->xfont, &idx, 1, &ext);
+		b->glyphs[b->nglyphs++] = idx;
+		elt->nchars++;
+		x += ext.xOff;
+	}
+	if (!elt->nchars)
+		return;
+	elt->glyphset = font->glyphset;
+
+	if (!b->nelts++) {
+		b->x1 = x0;
+		b->y1 = y - font->xfont->ascent;
+		b->x2 = x;
+		b->y2 = y + font->xfont->descent;
+	} else {
+		b->x1 = MIN(b->x1, x0);
+		b->y1 = MIN(b->y1, y - font->xfont->ascent);
+		b->x2 = MAX(b->x2, x);
+		b->y2 = MAX(b->y2, y + font->xfont->descent);
+	}
+	b->penx = x;
+	b->peny = y;
+}
+#endif
+
 Drw *
 drw_create(Display *dpy, int screen, Window root, unsigned int w, unsigned int h)
 {
@@ -54,33 +294,62 @@ drw_create(Display *dpy, int screen, Window root, unsigned int w, unsigned int h
 	drw->dpy = dpy;
 	drw->screen = screen;
 	drw->root = root;
-	drw->w = w;
-	drw->h = h;
-	drw->drawable = XCreatePixmap(dpy, root, w, h, DefaultDepth(dpy, screen));
 	drw->gc = XCreateGC(dpy, root, 0, NULL);
+	drw->fontgen = 1;
+	/* without a size the caller provides drawables with drw_setdrawable() */
+	if (w && h) {
+		drw->pixmap = XCreatePixmap(dpy, root, w, h, DefaultDepth(dpy, screen));
+		drw_setdrawable(drw, drw->pixmap, w, h);
+	}
 	XSetLineAttributes(dpy, drw->gc, 1, LineSolid, CapButt, JoinMiter);
 
 	return drw;
 }
 
 void
-drw_resize(Drw *drw, unsigned int w, unsigned int h)
+drw_setdrawable(Drw *drw, Drawable d, unsigned int w, unsigned int h)
 {
 	if (!drw)
 		return;
 
 	drw->w = w;
 	drw->h = h;
-	if (drw->drawable)
-		XFreePixmap(drw->dpy, drw->drawable);
-	drw->drawable = XCreatePixmap(drw->dpy, drw->root, w, h, DefaultDepth(drw->dpy, drw->screen));
+	if (drw->drawable == d)
+		return;
+#ifdef XRENDER_GLYPHS
+	batch_flush(drw);
+	if (drw->batch.dst)
+		XRenderFreePicture(drw->dpy, drw->batch.dst);
+	drw->batch.dst = XRenderCreatePicture(drw->dpy, d,
+		XRenderFindVisualFormat(drw->dpy, DefaultVisual(drw->dpy, drw->screen)), 0, NULL);
+#endif
+	drw->drawable = d;
+	if (drw->xftdraw)
+		XftDrawChange(drw->xftdraw, d);
+	else
+		drw->xftdraw = XftDrawCreate(drw->dpy, d, DefaultVisual(drw->dpy, drw->screen),
+		                             DefaultColormap(drw->dpy, drw->screen));
 }
 
 void
 drw_free(Drw *drw)
 {
-	XFreePixmap(drw->dpy, drw->drawable);
+#ifdef XRENDER_GLYPHS
+	unsigned int i;
+
+	batch_flush(drw);
+	for (i = 0; i < drw->batch.nsolid; i++)
+		XRenderFreePicture(drw->dpy, drw->batch.solid[i].pict);
+	if (drw->batch.dst)
+		XRenderFreePicture(drw->dpy, drw->batch.dst);
+#endif
+	if (drw->xftdraw)
+		XftDrawDestroy(drw->xftdraw);
+	if (drw->pixmap)
+		XFreePixmap(drw->dpy, drw->pixmap);
 	XFreeGC(drw->dpy, drw->gc);
+	fallback_stop(drw);
+	fontset_changed(drw);
 	drw_fontset_free(drw->fonts);
 	free(drw);
 }
@@ -135,6 +404,11 @@ xfont_free(Fnt *font)
 		return;
 	if (font->pattern)
 		FcPatternDestroy(font->pattern);
+#ifdef XRENDER_GLYPHS
+	if (font->glyphset)
+		XRenderFreeGlyphSet(font->dpy, font->glyphset);
+	free(font->uploaded);
+#endif
 	XftFontClose(font->dpy, font->xfont);
 	free(font);
 }
@@ -154,6 +428,7 @@ drw_fontset_create(Drw *drw, const char *fonts[], size_t fontcount)
 			ret = cur;
 		}
 	}
+	fontset_changed(drw);
 	return (drw->fonts = ret);
 }
 
@@ -198,8 +473,10 @@ drw_scm_create(Drw *drw, const char *clrnames[], size_t clrcount)
 void
 drw_setfontset(Drw *drw, Fnt *set)
 {
-	if (drw)
+	if (drw) {
 		drw->fonts = set;
+		fontset_changed(drw);
+	}
 }
 
 void
@@ -214,6 +491,19 @@ drw_rect(Drw *drw, int x, int y, unsigned int w, unsigned int h, int filled, int
 {
 	if (!drw || !drw->scheme)
 		return;
+#ifdef XRENDER_GLYPHS
+	Clr *clr = &drw->scheme[invert ? ColBg : ColFg];
+
+	if (filled) {
+		batch_rect(drw, x, y, w, h, clr);
+	} else {
+		batch_rect(drw, x, y, w, 1, clr);
+		batch_rect(drw, x, y + h - 1, w, 1, clr);
+		batch_rect(drw, x, y + 1, 1, h - 2, clr);
+		batch_rect(drw, x + w - 1, y + 1, 1, h - 2, clr);
+	}
+	return;
+#endif
 	XSetForeground(drw->dpy, drw->gc, invert ? drw->scheme[ColBg].pixel : drw->scheme[ColFg].pixel);
 	if (filled)
 		XFillRectangle(drw->dpy, drw->drawable, drw->gc, x, y, w, h);
@@ -221,23 +511,518 @@ drw_rect(Drw *drw, int x, int y, unsigned int w, unsigned int h, int filled, int
 		XDrawRectangle(drw->dpy, drw->drawable, drw->gc, x, y, w - 1, h - 1);
 }
 
+/* advance of a Latin-1 codepoint in the primary font, -1 if it is missing */
+static int
+primary_advance(Drw *drw, long cp)
+{
+	XGlyphInfo ext;
+	FcChar32 c = cp;
+
+	if (!drw->advance[cp]) {
+		if (XftCharExists(drw->dpy, drw->fonts->xfont, c)) {
+			XftTextExtents32(drw->dpy, drw->fonts->xfont, &c, 1, &ext);
+			drw->advance[cp] = ext.xOff + 1;
+		} else {
+			drw->advance[cp] = -1;
+		}
+	}
+	return drw->advance[cp] < 0 ? -1 : drw->advance[cp] - 1;
+}
+
+static DrwBlock *
+block_get(Drw *drw, long cp)
+{
+	unsigned int key = (cp >> 6) + 1, i;
+
+	i = (key * 0x9E3779B1u) & (DRW_BLOCKS - 1);
+	for (; drw->blocks[i].key; i = (i + 1) & (DRW_BLOCKS - 1))
+		if (drw->blocks[i].key == key)
+			return &drw->blocks[i];
+
+	/* keep probes short, start over rather than growing */
+	if (drw->nblocks >= DRW_BLOCKS * 3 / 4) {
+		memset(drw->blocks, 0, sizeof(drw->blocks));
+		drw->nblocks = 0;
+		i = (key * 0x9E3779B1u) & (DRW_BLOCKS - 1);
+	}
+	drw->nblocks++;
+	drw->blocks[i].key = key;
+	return &drw->blocks[i];
+}
+
+static Fnt *
+slot_font(Drw *drw, unsigned int slot)
+{
+	Fnt *f;
+
+	if (slot >= DRW_SLOT_FALLBACK) {
+		slot -= DRW_SLOT_FALLBACK;
+		drw->fallbackuse[slot] = ++drw->usetick;
+		return drw->fallback[slot];
+	}
+	for (f = drw->fonts; f && slot; f = f->next, slot--);
+	return f;
+}
+
+/* pattern for a font like the primary one that has cp, ready for FcFontMatch() */
+static FcPattern *
+fallback_pattern(Drw *drw, long cp)
+{
+	FcCharSet *fccharset;
+	FcPattern *fcpattern;
+
+	if (!drw->fonts->pattern) {
+		/* Refer to the comment in xfont_create for more information. */
+		die("the first font in the cache must be loaded from a font string.");
+	}
+
+	fccharset = FcCharSetCreate();
+	FcCharSetAddChar(fccharset, cp);
+
+	fcpattern = FcPatternDuplicate(drw->fonts->pattern);
+	FcPatternAddCharSet(fcpattern, FC_CHARSET, fccharset);
+	FcPatternAddBool(fcpattern, FC_SCALABLE, FcTrue);
+
+	FcConfigSubstitute(NULL, fcpattern, FcMatchPattern);
+	FcDefaultSubstitute(fcpattern);
+	/* the part of XftFontMatch() that needs the display */
+	FcConfigSubstitute(NULL, fcpattern, FcMatchPattern);
+	XftDefaultSubstitute(drw->dpy, drw->screen, fcpattern);
+
+	FcCharSetDestroy(fccharset);
+	return fcpattern;
+}
+
+/* open match (taking it over) into the least recently used fallback slot */
+static int
+fallback_install(Drw *drw, long cp, FcPattern *match)
+{
+	Fnt *font;
+	unsigned int i, lru = 0, b;
+	unsigned char slot;
+
+	/* several lookups in flight can end up at the same font */
+	for (i = 0; i < DRW_FALLBACKS; i++)
+		if (drw->fallback[i] && XftCharExists(drw->dpy, drw->fallback[i]->xfont, cp)) {
+			FcPatternDestroy(match);
+			return DRW_SLOT_FALLBACK + i;
+		}
+
+	font = xfont_create(drw, NULL, match);
+	if (!font || !XftCharExists(drw->dpy, font->xfont, cp)) {
+		xfont_free(font);
+		return -1;
+	}
+
+	for (i = 0; i < DRW_FALLBACKS; i++) {
+		if (!drw->fallback[i]) {
+			lru = i;
+			break;
+		}
+		if (drw->fallbackuse[i] < drw->fallbackuse[lru])
+			lru = i;
+	}
+	if (drw->fallback[lru]) {
+		/* forget every codepoint that resolved to the evicted font */
+		slot = DRW_SLOT_FALLBACK + lru;
+		for (b = 0; b < DRW_BLOCKS; b++)
+			for (i = 0; drw->blocks[b].key && i < 64; i++)
+				if (drw->blocks[b].slot[i] == slot)
+					drw->blocks[b].known &= ~(1ULL << i);
+#ifdef XRENDER_GLYPHS
+		batch_flush(drw);
+#endif
+		xfont_free(drw->fallback[lru]);
+	}
+	drw->fallback[lru] = font;
+	drw->fallbackuse[lru] = ++drw->usetick;
+	return DRW_SLOT_FALLBACK + lru;
+}
+
+/* hand the outcome of a lookup to the persistent cache */
+static void
+fallback_remember(Drw *drw, long cp, int slot)
+{
+	if (drw->cachestore)
+		drw->cachestore(cp, slot < 0 ? NULL : drw->fallback[slot - DRW_SLOT_FALLBACK]->xfont->pattern);
+}
+
+/* load a fallback font covering cp, blocking until fontconfig found one */
+static int
+fallback_load(Drw *drw, long cp)
+{
+	FcPattern *fcpattern, *match;
+	FcResult result;
+	int slot;
+
+	fcpattern = fallback_pattern(drw, cp);
+	match = FcFontMatch(NULL, fcpattern, &result);
+	FcPatternDestroy(fcpattern);
+
+	slot = match ? fallback_install(drw, cp, match) : -1;
+	fallback_remember(drw, cp, slot);
+	return slot;
+}
+
+/*
+ * With drw_fallback_async() the FcFontMatch() of a fallback lookup, which
+ * has to consider every installed font, runs on a resolver thread. Until
+ * the match is back the codepoint is drawn as a placeholder box, the owner
+ * is notified and opens the font with drw_fallback_collect().
+ */
+typedef struct DrwRequest {
+	struct DrwRequest *next;
+	long cp;
+	FcPattern *pattern;            /* what to match, replaced by the match (or NULL) */
+} DrwRequest;
+
+struct DrwResolver {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	DrwRequest *todo, *done;
+	int busy;                      /* a request is being matched */
+	unsigned int epoch;            /* bumped when the font set changes */
+	int quit;
+	void (*notify)(void *arg);
+	void *arg;
+	/* resolver thread only */
+	FcPattern *recent[DRW_FALLBACKS];
+	unsigned int nrecent;
+};
+
+/* font_for() result while a codepoint is being looked up */
+static Fnt pendingfont;
+
+static void
+requests_free(DrwRequest *r)
+{
+	DrwRequest *next;
+
+	for (; r; r = next) {
+		next = r->next;
+		if (r->pattern)
+			FcPatternDestroy(r->pattern);
+		free(r);
+	}
+}
+
+/* drop lookups made for the old font set, lock not held */
+static void
+fallback_forget(DrwResolver *res)
+{
+	pthread_mutex_lock(&res->lock);
+	res->epoch++;
+	requests_free(res->todo);
+	requests_free(res->done);
+	res->todo = res->done = NULL;
+	pthread_mutex_unlock(&res->lock);
+}
+
+/* a previous match that covers cp, most glyphs of a script come from one font */
+static FcPattern *
+recent_match(DrwResolver *res, long cp)
+{
+	FcCharSet *cs;
+	unsigned int i;
+
+	for (i = 0; i < MIN(res->nrecent, DRW_FALLBACKS); i++)
+		if (FcPatternGetCharSet(res->recent[i], FC_CHARSET, 0, &cs) == FcResultMatch
+		&& FcCharSetHasChar(cs, cp))
+			return FcPatternDuplicate(res->recent[i]);
+	return NULL;
+}
+
+static void
+recent_add(DrwResolver *res, FcPattern *match)
+{
+	FcPattern **p = &res->recent[res->nrecent++ % DRW_FALLBACKS];
+
+	if (*p)
+		FcPatternDestroy(*p);
+	*p = FcPatternDuplicate(match);
+}
+
+static void
+recent_clear(DrwResolver *res)
+{
+	unsigned int i;
+
+	for (i = 0; i < DRW_FALLBACKS; i++) {
+		if (res->recent[i])
+			FcPatternDestroy(res->recent[i]);
+		res->recent[i] = NULL;
+	}
+	res->nrecent = 0;
+}
+
+static void *
+resolver_loop(void *arg)
+{
+	DrwResolver *res = arg;
+	DrwRequest *r;
+	FcPattern *match;
+	FcResult result;
+	unsigned int epoch, seen = 0;
+
+	pthread_mutex_lock(&res->lock);
+	while (!res->quit) {
+		if (!(r = res->todo)) {
+			pthread_cond_wait(&res->cond, &res->lock);
+			continue;
+		}
+		res->todo = r->next;
+		res->busy = 1;
+		epoch = res->epoch;
+		pthread_mutex_unlock(&res->lock);
+
+		if (epoch != seen) {
+			recent_clear(res);
+			seen = epoch;
+		}
+		if (!(match = recent_match(res, r->cp))
+		&& (match = FcFontMatch(NULL, r->pattern, &result)))
+			recent_add(res, match);
+		FcPatternDestroy(r->pattern);
+		r->pattern = match;
+
+		pthread_mutex_lock(&res->lock);
+		res->busy = 0;
+		if (epoch != res->epoch) {
+			/* the font set changed while matching */
+			r->next = NULL;
+			requests_free(r);
+			continue;
+		}
+		r->next = res->done;
+		res->done = r;
+		if (res->notify) {
+			pthread_mutex_unlock(&res->lock);
+			res->notify(res->arg);
+			pthread_mutex_lock(&res->lock);
+		}
+	}
+	pthread_mutex_unlock(&res->lock);
+	return NULL;
+}
+
+static void
+fallback_request(Drw *drw, long cp)
+{
+	DrwResolver *res = drw->resolver;
+	DrwRequest *r = ecalloc(1, sizeof(DrwRequest));
+
+	r->cp = cp;
+	r->pattern = fallback_pattern(drw, cp);
+	pthread_mutex_lock(&res->lock);
+	r->next = res->todo;
+	res->todo = r;
+	pthread_cond_signal(&res->cond);
+	pthread_mutex_unlock(&res->lock);
+}
+
+static void
+fallback_stop(Drw *drw)
+{
+	DrwResolver *res = drw->resolver;
+
+	if (!res)
+		return;
+	pthread_mutex_lock(&res->lock);
+	res->quit = 1;
+	pthread_cond_signal(&res->cond);
+	pthread_mutex_unlock(&res->lock);
+	pthread_join(res->thread, NULL);
+
+	requests_free(res->todo);
+	requests_free(res->done);
+	recent_clear(res);
+	pthread_cond_destroy(&res->cond);
+	pthread_mutex_destroy(&res->lock);
+	free(res);
+	drw->resolver = NULL;
+}
+
+int
+drw_fallback_async(Drw *drw, void (*notify)(void *arg), void *arg)
+{
+	DrwResolver *res;
+
+	if (!drw || drw->resolver)
+		return drw != NULL;
+
+	res = ecalloc(1, sizeof(DrwResolver));
+	res->notify = notify;
+	res->arg = arg;
+	pthread_mutex_init(&res->lock, NULL);
+	pthread_cond_init(&res->cond, NULL);
+	if (pthread_create(&res->thread, NULL, resolver_loop, res)) {
+		pthread_cond_destroy(&res->cond);
+		pthread_mutex_destroy(&res->lock);
+		free(res);
+		return 0;
+	}
+	drw->resolver = res;
+	return 1;
+}
+
+void
+drw_fallback_cache(Drw *drw, int (*lookup)(long cp, FcPattern **match),
+                   void (*store)(long cp, const FcPattern *match))
+{
+	if (!drw)
+		return;
+	drw->cachelookup = lookup;
+	drw->cachestore = store;
+}
+
+int
+drw_fallback_collect(Drw *drw)
+{
+	DrwRequest *r, *next;
+	DrwBlock *blk;
+	uint64_t bit;
+	int slot, n = 0;
+
+	if (!drw || !drw->resolver)
+		return 0;
+
+	pthread_mutex_lock(&drw->resolver->lock);
+	r = drw->resolver->done;
+	drw->resolver->done = NULL;
+	pthread_mutex_unlock(&drw->resolver->lock);
+
+	for (; r; r = next, n++) {
+		next = r->next;
+		slot = r->pattern ? fallback_install(drw, r->cp, r->pattern) : -1;
+		fallback_remember(drw, r->cp, slot);
+		bit = 1ULL << (r->cp & 63);
+		blk = block_get(drw, r->cp);
+		blk->pending &= ~bit;
+		if (slot < 0) {
+			blk->missing |= bit;
+		} else {
+			blk->slot[r->cp & 63] = slot;
+			blk->known |= bit;
+		}
+		free(r);
+	}
+	/* widths measured with placeholder boxes are stale now */
+	if (n)
+		drw->fontgen++;
+	return n;
+}
+
+/* nonzero when no lookup is queued, running or waiting to be collected */
+int
+drw_fallback_idle(Drw *drw)
+{
+	int idle;
+
+	if (!drw || !drw->resolver)
+		return 1;
+	pthread_mutex_lock(&drw->resolver->lock);
+	idle = !drw->resolver->todo && !drw->resolver->done && !drw->resolver->busy;
+	pthread_mutex_unlock(&drw->resolver->lock);
+	return idle;
+}
+
+/* font that has a glyph for cp, NULL if none could be found */
+static Fnt *
+font_for(Drw *drw, long cp)
+{
+	DrwBlock *blk = block_get(drw, cp);
+	uint64_t bit = 1ULL << (cp & 63);
+	FcPattern *match;
+	Fnt *f;
+	int slot;
+
+	if (blk->known & bit)
+		return slot_font(drw, blk->slot[cp & 63]);
+	if (blk->missing & bit)
+		return NULL;
+	if (blk->pending & bit)
+		return &pendingfont;
+
+	for (f = drw->fonts, slot = 0; f && slot < DRW_SLOT_FALLBACK; f = f->next, slot++)
+		if (XftCharExists(drw->dpy, f->xfont, cp))
+			goto found;
+	for (slot = 0; slot < DRW_FALLBACKS; slot++)
+		if (drw->fallback[slot] && XftCharExists(drw->dpy, drw->fallback[slot]->xfont, cp)) {
+			slot += DRW_SLOT_FALLBACK;
+			goto found;
+		}
+	/* fonts found by earlier runs are opened without asking fontconfig */
+	if (drw->cachelookup && (slot = drw->cachelookup(cp, &match))) {
+		if (slot < 0) {
+			blk->missing |= bit;
+			return NULL;
+		}
+		if ((slot = fallback_install(drw, cp, match)) >= 0)
+			goto found;
+	}
+	if (drw->resolver) {
+		fallback_request(drw, cp);
+		blk->pending |= bit;
+		return &pendingfont;
+	}
+	if ((slot = fallback_load(drw, cp)) < 0) {
+		/* the block may have been reused while loading */
+		blk = block_get(drw, cp);
+		blk->missing |= bit;
+		return NULL;
+	}
+found:
+	blk = block_get(drw, cp);
+	blk->slot[cp & 63] = slot;
+	blk->known |= bit;
+	return slot_font(drw, slot);
+}
+
+static unsigned int
+placeholder_width(Drw *drw)
+{
+	return MAX(drw->fonts->h / 2, 1);
+}
+
+/* n outlined boxes standing in for glyphs whose font is still being looked up */
+static void
+placeholder_draw(Drw *drw, int x, int y, unsigned int n, unsigned int h, Clr *clr)
+{
+	unsigned int bw = placeholder_width(drw), bh = drw->fonts->xfont->ascent, i;
+	int by = y + ((int)h - (int)drw->fonts->h) / 2;
+
+	drw->placeholders++;
+	if (bw < 3 || bh < 2)
+		return;
+#ifndef XRENDER_GLYPHS
+	XSetForeground(drw->dpy, drw->gc, clr->pixel);
+#endif
+	for (i = 0; i < n; i++, x += bw) {
+#ifdef XRENDER_GLYPHS
+		batch_rect(drw, x + 1, by, bw - 2, 1, clr);
+		batch_rect(drw, x + 1, by + bh - 1, bw - 2, 1, clr);
+		batch_rect(drw, x + 1, by, 1, bh, clr);
+		batch_rect(drw, x + bw - 2, by, 1, bh, clr);
+#else
+		XDrawRectangle(drw->dpy, drw->drawable, drw->gc, x + 1, by, bw - 3, bh - 1);
+#endif
+	}
+}
+
 int
 drw_text(Drw *drw, int x, int y, unsigned int w, unsigned int h, unsigned int lpad, const char *text, int invert)
 {
 	int ty, ellipsis_x = 0;
-	unsigned int tmpw, ew, ellipsis_w = 0, ellipsis_len, hash, h0, h1;
-	XftDraw *d = NULL;
+	unsigned int tmpw, ew, ellipsis_w = 0, ellipsis_len;
 	Fnt *usedfont, *curfont, *nextfont;
 	int utf8strlen, utf8charlen, utf8err, render = x || y || w || h;
 	long utf8codepoint = 0;
 	const char *utf8str;
-	FcCharSet *fccharset;
-	FcPattern *fcpattern;
-	FcPattern *match;
-	XftResult result;
-	int charexists = 0, overflow = 0;
-	/* keep track of a couple codepoints for which we have no match. */
-	static unsigned int nomatches[128], ellipsis_width, invalid_width;
+	int forcechar = 0, overflow = 0, adv;
+	const char *end;
+	size_t run, i;
+	unsigned int runw;
 	static const char invalid[] = "�";
 
 	if (!drw || (render && (!drw->scheme || !w)) || !text || !drw->fonts)
@@ -246,79 +1031,108 @@ drw_text(Drw *drw, int x, int y, unsigned int w, unsigned int h, unsigned int lp
 	if (!render) {
 		w = invert ? invert : ~invert;
 	} else {
+#ifdef XRENDER_GLYPHS
+		batch_rect(drw, x, y, w, h, &drw->scheme[invert ? ColFg : ColBg]);
+#else
 		XSetForeground(drw->dpy, drw->gc, drw->scheme[invert ? ColFg : ColBg].pixel);
 		XFillRectangle(drw->dpy, drw->drawable, drw->gc, x, y, w, h);
+#endif
 		if (w < lpad)
 			return x + w;
-		d = XftDrawCreate(drw->dpy, drw->drawable,
-		                  DefaultVisual(drw->dpy, drw->screen),
-		                  DefaultColormap(drw->dpy, drw->screen));
 		x += lpad;
 		w -= lpad;
 	}
 
+	end = text + strlen(text);
 	usedfont = drw->fonts;
-	if (!ellipsis_width && render)
-		ellipsis_width = drw_fontset_getwidth(drw, "...");
-	if (!invalid_width && render)
-		invalid_width = drw_fontset_getwidth(drw, invalid);
+	if (!drw->ellipsiswidth && render)
+		drw->ellipsiswidth = drw_fontset_getwidth(drw, "...");
+	if (!drw->invalidwidth && render)
+		drw->invalidwidth = drw_fontset_getwidth(drw, invalid);
 	while (1) {
 		ew = ellipsis_len = utf8err = utf8charlen = utf8strlen = 0;
 		utf8str = text;
 		nextfont = NULL;
+		if (usedfont == drw->fonts && !forcechar) {
+			/* ASCII run in the primary font: one table lookup per character */
+			run = ascii_prefix(text, end - text);
+			for (i = 0, runw = 0; i < run && (adv = primary_advance(drw, (unsigned char)text[i])) >= 0; i++) {
+				/* stop where the ellipsis would no longer fit, overflow is left to the slow path */
+				if (ew + runw + adv + drw->ellipsiswidth > w)
+					break;
+				runw += adv;
+			}
+			if (i) {
+				ellipsis_x = x + ew + runw;
+				ellipsis_w = w - ew - runw;
+				ellipsis_len = utf8strlen + i;
+				text += i;
+				utf8strlen += i;
+				ew += runw;
+			}
+		}
 		while (*text) {
 			utf8charlen = utf8decode(text, &utf8codepoint, &utf8err);
-			for (curfont = drw->fonts; curfont; curfont = curfont->next) {
-				charexists = charexists || XftCharExists(drw->dpy, curfont->xfont, utf8codepoint);
-				if (charexists) {
+			curfont = font_for(drw, utf8codepoint);
+			/* no font has the glyph, draw it with the current one anyway */
+			if (!curfont && forcechar)
+				curfont = usedfont;
+			if (curfont) {
+				if (curfont == &pendingfont)
+					tmpw = placeholder_width(drw);
+				else
 					drw_font_getexts(curfont, text, utf8charlen, &tmpw, NULL);
-					if (ew + ellipsis_width <= w) {
-						/* keep track where the ellipsis still fits */
-						ellipsis_x = x + ew;
-						ellipsis_w = w - ew;
-						ellipsis_len = utf8strlen;
-					}
-
-					if (ew + tmpw > w) {
-						overflow = 1;
-						/* called from drw_fontset_getwidth_clamp():
-						 * it wants the width AFTER the overflow
-						 */
-						if (!render)
-							x += tmpw;
-						else
-							utf8strlen = ellipsis_len;
-					} else if (curfont == usedfont) {
-						text += utf8charlen;
-						utf8strlen += utf8err ? 0 : utf8charlen;
-						ew += utf8err ? 0 : tmpw;
-					} else {
-						nextfont = curfont;
-					}
-					break;
+				if (ew + drw->ellipsiswidth <= w) {
+					/* keep track where the ellipsis still fits */
+					ellipsis_x = x + ew;
+					ellipsis_w = w - ew;
+					ellipsis_len = utf8strlen;
+				}
+
+				if (ew + tmpw > w) {
+					overflow = 1;
+					/* called from drw_fontset_getwidth_clamp():
+					 * it wants the width AFTER the overflow
+					 */
+					if (!render)
+						x += tmpw;
+					else
+						utf8strlen = ellipsis_len;
+				} else if (curfont == usedfont) {
+					text += utf8charlen;
+					utf8strlen += utf8err ? 0 : utf8charlen;
+					ew += utf8err ? 0 : tmpw;
+				} else {
+					nextfont = curfont;
 				}
 			}
 
-			if (overflow || !charexists || nextfont || utf8err)
+			if (overflow || !curfont || nextfont || utf8err)
 				break;
 			else
-				charexists = 0;
+				forcechar = 0;
 		}
 
 		if (utf8strlen) {
-			if (render) {
+			if (render && usedfont == &pendingfont) {
+				placeholder_draw(drw, x, y, ew / placeholder_width(drw), h, &drw->scheme[invert ? ColBg : ColFg]);
+			} else if (render) {
 				ty = y + (h - usedfont->h) / 2 + usedfont->xfont->ascent;
-				XftDrawStringUtf8(d, &drw->scheme[invert ? ColBg : ColFg],
+#ifdef XRENDER_GLYPHS
+				batch_text(drw, usedfont, x, ty, utf8str, utf8strlen, &drw->scheme[invert ? ColBg : ColFg]);
+#else
+				XftDrawStringUtf8(drw->xftdraw, &drw->scheme[invert ? ColBg : ColFg],
 				                  usedfont->xfont, x, ty, (XftChar8 *)utf8str, utf8strlen);
+#endif
 			}
 			x += ew;
 			w -= ew;
 		}
-		if (utf8err && (!render || invalid_width < w)) {
+		if (utf8err && (!render || drw->invalidwidth < w)) {
 			if (render)
 				drw_text(drw, x, y, w, h, 0, invalid, invert);
-			x += invalid_width;
-			w -= invalid_width;
+			x += drw->invalidwidth;
+			w -= drw->invalidwidth;
 		}
 		if (render && overflow)
 			drw_text(drw, ellipsis_x, y, ellipsis_w, h, 0, "...", invert);
@@ -326,59 +1140,15 @@ drw_text(Drw *drw, int x, int y, unsigned int w, unsigned int h, unsigned int lp
 		if (!*text || overflow) {
 			break;
 		} else if (nextfont) {
-			charexists = 0;
+			forcechar = 0;
 			usedfont = nextfont;
 		} else {
 			/* Regardless of whether or not a fallback font is found, the
 			 * character must be drawn. */
-			charexists = 1;
-
-			hash = (unsigned int)utf8codepoint;
-			hash = ((hash >> 16) ^ hash) * 0x21F0AAAD;
-			hash = ((hash >> 15) ^ hash) * 0xD35A2D97;
-			h0 = ((hash >> 15) ^ hash) % LENGTH(nomatches);
-			h1 = (hash >> 17) % LENGTH(nomatches);
-			/* avoid expensive XftFontMatch call when we know we won't find a match */
-			if (nomatches[h0] == utf8codepoint || nomatches[h1] == utf8codepoint)
-				goto no_match;
-
-			fccharset = FcCharSetCreate();
-			FcCharSetAddChar(fccharset, utf8codepoint);
-
-			if (!drw->fonts->pattern) {
-				/* Refer to the comment in xfont_create for more information. */
-				die("the first font in the cache must be loaded from a font string.");
-			}
-
-			fcpattern = FcPatternDuplicate(drw->fonts->pattern);
-			FcPatternAddCharSet(fcpattern, FC_CHARSET, fccharset);
-			FcPatternAddBool(fcpattern, FC_SCALABLE, FcTrue);
-
-			FcConfigSubstitute(NULL, fcpattern, FcMatchPattern);
-			FcDefaultSubstitute(fcpattern);
-			match = XftFontMatch(drw->dpy, drw->screen, fcpattern, &result);
-
-			FcCharSetDestroy(fccharset);
-			FcPatternDestroy(fcpattern);
-
-			if (match) {
-				usedfont = xfont_create(drw, NULL, match);
-				if (usedfont && XftCharExists(drw->dpy, usedfont->xfont, utf8codepoint)) {
-					for (curfont = drw->fonts; curfont->next; curfont = curfont->next)
-						; /* NOP */
-					curfont->next = usedfont;
-				} else {
-					xfont_free(usedfont);
-					nomatches[nomatches[h0] ? h1 : h0] = utf8codepoint;
-no_match:
-					usedfont = drw->fonts;
-				}
-			}
+			forcechar = 1;
+			usedfont = drw->fonts;
 		}
 	}
-	if (d)
-		XftDrawDestroy(d);
-
 	return x + (render ? w : 0);
 }
 
@@ -388,16 +1158,59 @@ drw_map(Drw *drw, Window win, int x, int y, unsigned int w, unsigned int h)
 	if (!drw)
 		return;
 
+#ifdef XRENDER_GLYPHS
+	batch_flush(drw);
+#endif
 	XCopyArea(drw->dpy, drw->drawable, win, drw->gc, x, y, w, h, x, y);
-	XSync(drw->dpy, False);
+}
+
+/* width of text that is entirely Latin-1 in the primary font, 0 if it is not */
+static int
+latin1_width(Drw *drw, const char *text, unsigned int *w)
+{
+	const unsigned char *s = (const unsigned char *)text;
+	long cp;
+	int adv;
+
+	for (*w = 0; *s; *w += adv) {
+		if (*s < 0x80) {
+			cp = *s++;
+		} else if ((s[0] & 0xFE) == 0xC2 && (s[1] & 0xC0) == 0x80) {
+			cp = ((s[0] & 0x1F) << 6) | (s[1] & 0x3F);
+			s += 2;
+		} else {
+			return 0;
+		}
+		if ((adv = primary_advance(drw, cp)) < 0)
+			return 0;
+	}
+	return 1;
 }
 
 unsigned int
 drw_fontset_getwidth(Drw *drw, const char *text)
 {
+	DrwWidth *e;
+	uint64_t hash;
+	unsigned int len, w;
+
 	if (!drw || !drw->fonts || !text)
 		return 0;
-	return drw_text(drw, 0, 0, 0, 0, 0, text, 0);
+
+	len = strlen(text);
+	hash = hashbytes(HASH_INIT, text, len);
+	e = &drw->widths[hash & (DRW_WIDTHCACHE - 1)];
+	if (e->gen == drw->fontgen && e->hash == hash && e->len == len)
+		return e->w;
+
+	if (!latin1_width(drw, text, &w))
+		w = drw_text(drw, 0, 0, 0, 0, 0, text, 0);
+
+	e->gen = drw->fontgen;
+	e->hash = hash;
+	e->len = len;
+	e->w = w;
+	return w;
 }
 
 unsigned int
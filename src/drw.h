@@ -7,7 +7,7 @@
 
 /* Drawable abstraction */
 Drw *drw_create(Display *dpy, int screen, Window win, unsigned int w, unsigned int h);
-void drw_resize(Drw *drw, unsigned int w, unsigned int h);
+void drw_setdrawable(Drw *drw, Drawable d, unsigned int w, unsigned int h);
 void drw_free(Drw *drw);
 
 /* Fnt abstraction */
@@ -16,6 +16,11 @@ void drw_fontset_free(Fnt *set);
 unsigned int drw_fontset_getwidth(Drw *drw, const char *text);
 unsigned int drw_fontset_getwidth_clamp(Drw *drw, const char *text, unsigned int n);
 void drw_font_getexts(Fnt *font, const char *text, unsigned int len, unsigned int *w, unsigned int *h);
+int drw_fallback_async(Drw *drw, void (*notify)(void *arg), void *arg);
+int drw_fallback_collect(Drw *drw);
+int drw_fallback_idle(Drw *drw);
+void drw_fallback_cache(Drw *drw, int (*lookup)(long cp, FcPattern **match),
+                        void (*store)(long cp, const FcPattern *match));
 
 /* Colorscheme abstraction */
 void drw_clr_create(Drw *drw, Clr *dest, const char *clrname);
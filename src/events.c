@@ -2,12 +2,20 @@
 #include "config.h"
 #include "util.h"
 #include "barwin.h"
+#include "barrender.h"
 #include "cmds.h"
 #include "devpair.h"
 #include "monitor.h"
 #include "client.h"
 #include "resolvers.h"
 #include "drw.h"
+#include "xstate.h"
+#include "resizesync.h"
+#include "ewmh.h"
+#ifdef COMPOSITOR
+#include "comp.h"
+#include "overview.h"
+#endif
 
 #include <X11/extensions/XI2.h>
 #include <stdlib.h>
@@ -34,6 +42,8 @@ static void xi2enter(void *ev);
 static void xi2focusin(void *ev);
 static void xi2hierarchychanged(void *ev);
 
+static void postmoveselmon(DevPair *dp, Client *c);
+
 static void (*legacyhandler[LASTEvent]) (XEvent *) = {
     [Expose] = expose,
     [DestroyNotify] = destroynotify,
@@ -59,7 +69,13 @@ static void (*xi2handler[XI_LASTEVENT]) (void *) = {
 
 void fire_event(int ev_type, void *ev)
 {
-    if (legacyhandler[ev_type])
+#ifdef COMPOSITOR
+    if (compevent(ev))
+        return;
+#endif
+    if (gwm.syncevent >= 0 && ev_type == gwm.syncevent + XSyncAlarmNotify)
+        syncalarmnotify(ev);
+    else if (ev_type < LASTEvent && legacyhandler[ev_type])
         legacyhandler[ev_type](ev); /* call handler */
 }
 
@@ -68,8 +84,14 @@ void expose(XEvent *e)
     Monitor *m;
     XExposeEvent *ev = &e->xexpose;
 
-    if (ev->count == 0 && (m = anywintomon(ev->window)))
-        drawbar(m);
+#ifdef COMPOSITOR
+    if (ev->count == 0 && overviewexpose(ev->window))
+        return;
+#endif
+    if (ev->count == 0 && (m = anywintomon(ev->window))) {
+        invalidatebar(m);
+        markbar(m);
+    }
 }
 
 void destroynotify(XEvent *e)
@@ -81,6 +103,8 @@ void destroynotify(XEvent *e)
 
     if ((c = wintoclient(ev->window)))
         unmanage(c, 1);
+    else if ((c = wintopopup(ev->window)))
+        unmanagepopup(c, 1);
 }
 
 void maprequest(XEvent *e)
@@ -114,7 +138,7 @@ void maprequest(XEvent *e)
     DBG("  +maprequest %d, %d, %d, %lu, %lu\n", wa.bit_gravity, wa.win_gravity, wa.backing_store, wa.backing_planes, wa.backing_pixel);
     DBG("  +maprequest %d, %d, %d, %ld, %ld, %ld %d\n", wa.save_under, wa.map_installed, wa.map_state, wa.all_event_masks, wa.your_event_mask, wa.do_not_propagate_mask, wa.override_redirect);
     
-    if (!wintoclient(ev->window))
+    if (!wintoclient(ev->window) && !wintopopup(ev->window))
         manage(ev->window, &wa);
 }
 
@@ -128,6 +152,8 @@ void unmapnotify(XEvent *e)
             setclientstate(c, WithdrawnState);
         else
             unmanage(c, 0);
+    } else if (!ev->send_event && (c = wintopopup(ev->window))) {
+        unmanagepopup(c, 0);
     }
 }
 
@@ -148,7 +174,6 @@ void configurenotify(XEvent *e)
         gwm.sh = ev->height;
         DBG("NEW sw: %d, sh: %d\n", gwm.sw, gwm.sh);
         if (updategeom(NULL) || dirty) {
-            drw_resize(gdrw, gwm.sw, gwm.bh);
             updatebars();
             for (m = gwm.mons; m; m = m->next) {
                 for (c = m->clients; c; c = c->next)
@@ -174,6 +199,7 @@ void configurerequest(XEvent *e)
     if ((c = wintoclient(ev->window))) {
         if (ev->value_mask & CWBorderWidth) {
             c->bw = ev->border_width;
+            markdirty(c);
         }
         else if (c->isfloating || !c->mon->lt[c->mon->sellt]->arrange) {
             m = c->mon;
@@ -222,10 +248,7 @@ void configurerequest(XEvent *e)
                 DBG("+configurerequest configure 1 %lu %lu\n", c->win, ev->value_mask);
                 configure(c);
             }
-            if (ISVISIBLE(c)) {
-                DBG("+configurerequest Move resize window %lu\n", c->win);
-                XMoveResizeWindow(gwm.dpy, c->win, c->x, c->y, c->w, c->h);
-            }
+            markdirty(c);
         } else {
             DBG("+configurerequest configure 2 %lu %lu\n", c->win, ev->value_mask);
             configure(c);
@@ -245,11 +268,197 @@ void configurerequest(XEvent *e)
     XSync(gwm.dpy, False);
 }
 
+/* _NET_WM_MOVERESIZE directions, see the EWMH spec */
+#define NET_WM_MOVERESIZE_SIZE_KEYBOARD 9
+#define NET_WM_MOVERESIZE_MOVE_KEYBOARD 10
+#define NET_WM_MOVERESIZE_MOVE          8
+#define NET_WM_MOVERESIZE_CANCEL        11
+#define MOVERESIZE_STEP                 10  /* px per arrow key of a keyboard move/resize */
+
+static const int netmoveresizeedges[] = {
+    EdgeTop|EdgeLeft, EdgeTop, EdgeTop|EdgeRight, EdgeRight,
+    EdgeBottom|EdgeRight, EdgeBottom, EdgeBottom|EdgeLeft, EdgeLeft,
+};
+
+/*
+ * device pair that asked for the move/resize: the one whose pointer is at
+ * the given root position, else the one that focused the client last
+ */
+static DevPair *netmoveresizedevpair(Client *c, int x, int y)
+{
+    DevPair *dp;
+    int px, py;
+
+    for (dp = gwm.devpairs; dp; dp = dp->next)
+        if (dp->mptr && getrootptr(dp, &px, &py) && px == x && py == y)
+            return dp;
+    return c->devstack_end ? c->devstack_end : gwm.devpairs;
+}
+
+static void ungrabkeyboard(DevPair *dp, Motion *mm)
+{
+    if (mm->keyboard && dp->mkbd)
+        XIUngrabDevice(gwm.dpy, dp->mkbd->info.deviceid, CurrentTime);
+    mm->keyboard = 0;
+}
+
+static void netmoveresizecancel(Client *c)
+{
+    DevPair *dp;
+    Motion *mm;
+
+    for (dp = gwm.devpairs; dp; dp = dp->next) {
+        if (dp->move.c == c)
+            mm = &dp->move;
+        else if (dp->resize.c == c) {
+            mm = &dp->resize;
+            syncend(c, 0);
+        } else
+            continue;
+        resize(c, mm->sx, mm->sy, mm->sw, mm->sh, 1);
+        XIUngrabDevice(gwm.dpy, dp->mptr->info.deviceid, CurrentTime);
+        ungrabkeyboard(dp, mm);
+        dp->move.c = dp->resize.c = NULL;
+    }
+}
+
+/* the keyboard moved or resized by a step, the pointer offsets stay valid */
+static void netmoveresizestep(DevPair *dp, Motion *mm, int dx, int dy)
+{
+    Client *c = mm->c;
+    int w, h;
+
+    if (c->isfullscreen)
+        return;
+    if (mm == &dp->move) {
+        mm->ox += dx;
+        mm->oy += dy;
+        if (c->isfloating)
+            resize(c, c->x + dx, c->y + dy, c->w, c->h, 1);
+        return;
+    }
+    mm->ow = MAX(mm->ow + dx, 1);
+    mm->oh = MAX(mm->oh + dy, 1);
+    if (!c->isfloating && c->mon->lt[c->mon->sellt]->arrange)
+        setfloating(c, 1, 0, 1);
+    /* while the client has not answered, step from the size it was asked for */
+    w = c->sync.pending ? c->sync.w : c->w;
+    h = c->sync.pending ? c->sync.h : c->h;
+    syncresize(c, c->x, c->y, MAX(w + dx, 1), MAX(h + dy, 1), dp->lastevent);
+}
+
+/*
+ * keys of a keyboard move/resize: the arrows move or resize by
+ * MOVERESIZE_STEP, Return ends it, Escape restores the geometry it started
+ * with. Returns 1 if the key was used up.
+ */
+static int netmoveresizekey(DevPair *dp, KeySym keysym)
+{
+    Motion *mm = dp->move.keyboard ? &dp->move : dp->resize.keyboard ? &dp->resize : NULL;
+    Client *c;
+
+    if (!mm || !(c = mm->c))
+        return 0;
+    switch (keysym) {
+    case XK_Left:  netmoveresizestep(dp, mm, -MOVERESIZE_STEP, 0); break;
+    case XK_Right: netmoveresizestep(dp, mm, MOVERESIZE_STEP, 0); break;
+    case XK_Up:    netmoveresizestep(dp, mm, 0, -MOVERESIZE_STEP); break;
+    case XK_Down:  netmoveresizestep(dp, mm, 0, MOVERESIZE_STEP); break;
+    case XK_Escape:
+        netmoveresizecancel(c);
+        break;
+    case XK_Return:
+    case XK_KP_Enter:
+        XIUngrabDevice(gwm.dpy, dp->mptr->info.deviceid, CurrentTime);
+        ungrabkeyboard(dp, mm);
+        if (mm == &dp->resize)
+            syncend(c, 1);
+        postmoveselmon(dp, c);
+        mm->c = NULL;
+        break;
+    }
+    return 1;
+}
+
+/*
+ * hand the drag to movemouse()/resizemouse() so client side decorated windows
+ * are moved by the wm instead of a flood of ConfigureRequests
+ */
+static void netmoveresize(Client *c, XClientMessageEvent *cme)
+{
+    unsigned char keymask[XIMaskLen(XI_LASTEVENT)];
+    XIEventMask keyevm = { .mask_len = sizeof(keymask), .mask = keymask };
+    DevPair *dp;
+    Motion *mm;
+    long dir = cme->data.l[2];
+
+    if (dir == NET_WM_MOVERESIZE_CANCEL) {
+        netmoveresizecancel(c);
+        return;
+    }
+    if (dir < 0 || dir > NET_WM_MOVERESIZE_MOVE_KEYBOARD || c->isfullscreen)
+        return;
+    if (!(dp = netmoveresizedevpair(c, cme->data.l[0], cme->data.l[1])) || !dp->mptr)
+        return;
+    if (dp->move.c || dp->resize.c)
+        return;
+
+    DBG("+netmoveresize %lu %ld\n", c->win, dir);
+
+    /* keyboard variants have no button held, any button ends the drag */
+    dp->lastdetail = dir >= NET_WM_MOVERESIZE_SIZE_KEYBOARD ? 0 : cme->data.l[3];
+    if (dir == NET_WM_MOVERESIZE_MOVE || dir == NET_WM_MOVERESIZE_MOVE_KEYBOARD) {
+        mm = &dp->move;
+        mm->c = c;
+        mm->detail = -1;
+        movemouse(dp, &(Arg){0});
+    } else {
+        mm = &dp->resize;
+        mm->c = c;
+        mm->detail = -1;
+        mm->edges = dir == NET_WM_MOVERESIZE_SIZE_KEYBOARD
+            ? EdgeBottom|EdgeRight : netmoveresizeedges[dir];
+        resizemouse(dp, &(Arg){0});
+    }
+    /* the grab failed, the detail is only set once the drag started */
+    if (mm->detail < 0) {
+        mm->c = NULL;
+        return;
+    }
+    if (dir < NET_WM_MOVERESIZE_SIZE_KEYBOARD || !dp->mkbd)
+        return;
+    memset(keymask, 0, sizeof(keymask));
+    XISetMask(keymask, XI_KeyPress);
+    keyevm.deviceid = dp->mkbd->info.deviceid;
+    mm->keyboard = XIGrabDevice(gwm.dpy, dp->mkbd->info.deviceid, gwm.root, CurrentTime, None,
+        XIGrabModeAsync, XIGrabModeAsync, False, &keyevm) == GrabSuccess;
+}
+
+/* _NET_MOVERESIZE_WINDOW is a ConfigureRequest without the XSync */
+static void netmoveresizewindow(Client *c, XClientMessageEvent *cme)
+{
+    long flags = cme->data.l[0];
+    int x, y, w, h;
+
+    if (c->isfullscreen || (!c->isfloating && c->mon->lt[c->mon->sellt]->arrange))
+        return;
+
+    x = flags & (1 << 8) ? cme->data.l[1] : c->x;
+    y = flags & (1 << 9) ? cme->data.l[2] : c->y;
+    w = flags & (1 << 10) ? cme->data.l[3] : c->w;
+    h = flags & (1 << 11) ? cme->data.l[4] : c->h;
+    resize(c, x, y, w, h, 1);
+}
+
 void clientmessage(XEvent *e)
 {
     XClientMessageEvent *cme = &e->xclient;
     Client *c = wintoclient(cme->window);
 
+    if (cme->window == gwm.root && cme->message_type == gwm.netatom[NetCurrentDesktop]) {
+        ewmhcurrentdesktop(cme->data.l[0]);
+        return;
+    }
     if (!c)
         return;
     if (cme->message_type == gwm.netatom[NetWMState]) {
@@ -260,6 +469,10 @@ void clientmessage(XEvent *e)
     } else if (cme->message_type == gwm.netatom[NetActiveWindow]) {
         if (!c->isurgent && !c->devices)
             seturgent(c, 1);
+    } else if (cme->message_type == gwm.netatom[NetWMMoveResize]) {
+        netmoveresize(c, cme);
+    } else if (cme->message_type == gwm.netatom[NetMoveResizeWindow]) {
+        netmoveresizewindow(c, cme);
     }
 }
 
@@ -297,13 +510,10 @@ void propertynotify(XEvent *e)
             break;
         case XA_WM_HINTS:
             updatewmhints(c);
-            drawbars();
             break;
         }
         if (ev->atom == XA_WM_NAME || ev->atom == gwm.netatom[NetWMName]) {
             updatetitle(c);
-            if (c->devices)
-                drawbar(c->mon);
         }
         if (ev->atom == gwm.netatom[NetWMWindowType])
             updatewindowtype(c);
@@ -334,6 +544,8 @@ void xi2keypress(void *ev)
     
     keysym = XkbKeycodeToKeysym(gwm.dpy, (KeyCode)e->detail, 0, 0);
     dp->lastevent = e->time;
+    if (netmoveresizekey(dp, keysym))
+        return;
     for (i = 0; i < gkeys_len; i++) {
         if (keysym == gkeys[i].keysym
         && CLEANMASK(gkeys[i].mod) == CLEANMASK(e->mods.effective)
@@ -344,13 +556,19 @@ void xi2keypress(void *ev)
 
 void xi2buttonpress(void *ev)
 {
-    unsigned int i, x, click = ClkRootWin;
+    unsigned int i, click = ClkRootWin;
     XIDeviceEvent *e = ev;
     DevPair *dp = getdevpair(e->deviceid);
     Arg arg = {0};
+    BarLayout l;
+    const BarRange *r;
     Monitor *m;
     Client *c;
     
+#ifdef COMPOSITOR
+    if (overviewclick(dp, e))
+        return;
+#endif
     /* focus monitor if necessary */
     if ((m = wintomon(dp, e->event)) && m != dp->selmon) {
         unfocus(dp, 1);
@@ -358,19 +576,17 @@ void xi2buttonpress(void *ev)
         focus(dp, NULL);
     }
     if (e->event == dp->selmon->barwin) {
-        i = x = 0;
-        do
-            x += TEXTW(gtags[i]);
-        while (e->event_x >= x && ++i < gtags_len);
-        if (i < gtags_len) {
-            click = ClkTagBar;
-            arg.ui = 1 << i;
-        } else if (e->event_x < x + TEXTW(dp->selmon->ltsymbol))
-            click = ClkLtSymbol;
-        else if (e->event_x > dp->selmon->ww - (int)TEXTW(gwm.stext))
-            click = ClkStatusText;
-        else
-            click = ClkWinTitle;
+        /* geometry as the renderer last drew it, no text is measured here */
+        barlayout(dp->selmon->barslot, &l);
+        click = ClkWinTitle;
+        if ((r = barhit(&l, e->event_x))) {
+            click = r->click;
+            if (click == ClkTagBar)
+                arg.t = TAGBIT(r->tag);
+            /* like a click into the window, the title's client gets the focus */
+            else if (click == ClkWinTitle && (c = wintoclient(r->win)) && c != dp->sel)
+                focus(dp, c);
+        }
     } else if ((c = wintoclient(e->event))) {
         focus(dp, c);
         if (dp->sel == c) {
@@ -388,7 +604,7 @@ void xi2buttonpress(void *ev)
             gbuttons[i].func(dp, click == ClkTagBar && gbuttons[i].arg.i == 0 ? &arg : &gbuttons[i].arg);
 }
 
-void postmoveselmon(DevPair *dp, Client *c)
+static void postmoveselmon(DevPair *dp, Client *c)
 {
     Monitor *m;
     int x, y;
@@ -422,8 +638,8 @@ void xi2buttonrelease(void *ev)
     Motion *mm;
 
     dp->lastevent = e->time;
-    if ((*(pc = &dp->move.c) && (mm = &dp->resize) && dp->move.detail == e->detail) ||
-        (*(pc = &dp->resize.c) && (mm = &dp->move) && dp->resize.detail == e->detail)) {
+    if ((*(pc = &dp->move.c) && (mm = &dp->resize) && (!dp->move.detail || dp->move.detail == e->detail)) ||
+        (*(pc = &dp->resize.c) && (mm = &dp->move) && (!dp->resize.detail || dp->resize.detail == e->detail))) {
         int newcursor = (dp->move.c && dp->resize.c) ? ((mm == &dp->resize) ? CurResize : CurMove) : CurNormal;
         dp->lastdetail = mm->detail;
         switch(newcursor) {
@@ -437,6 +653,9 @@ void xi2buttonrelease(void *ev)
                 XIUngrabDevice(gwm.dpy, dp->mptr->info.deviceid, CurrentTime);
                 break;
         }
+        ungrabkeyboard(dp, pc == &dp->move.c ? &dp->move : &dp->resize);
+        if (pc == &dp->resize.c)
+            syncend(*pc, 1);
         postmoveselmon(dp, *pc);
         *pc = NULL;
     }
@@ -452,12 +671,8 @@ void xi2motion(void *ev)
 
     if (!e->child) {
         sw = e->event;
-        for(m = gwm.mons; m; m = m->next) {
-            if (m->barwin == sw) {
-                sw = gwm.root;
-                break;
-            }
-        }
+        if ((m = wintobar(sw)))
+            sw = gwm.root;
     } else {
         sw = e->child;
     }
@@ -500,14 +715,32 @@ void xi2motion(void *ev)
     }
     else if ((c = dp->resize.c) && dp->resize.time > dp->move.time)
     {
-        int nw, nh;
+        int nx = c->x, ny = c->y, nw, nh;
+        int dx = (int)e->root_x - dp->resize.x, dy = (int)e->root_y - dp->resize.y;
 
         if ((e->time - dp->resize.time) <= (1000 / 250))
             return;
 
         dp->resize.time = e->time;
-        nw = MAX(e->root_x - dp->resize.ox - 2 * c->bw + 1, 1);
-        nh = MAX(e->root_y - dp->resize.oy - 2 * c->bw + 1, 1);
+        if (!dp->resize.edges) {
+            nw = MAX(e->root_x - dp->resize.ox - 2 * c->bw + 1, 1);
+            nh = MAX(e->root_y - dp->resize.oy - 2 * c->bw + 1, 1);
+        } else {
+            nw = dp->resize.ow;
+            nh = dp->resize.oh;
+            if (dp->resize.edges & EdgeLeft) {
+                nw = MAX(dp->resize.ow - dx, 1);
+                nx = dp->resize.ox + dp->resize.ow - nw;
+            } else if (dp->resize.edges & EdgeRight) {
+                nw = MAX(dp->resize.ow + dx, 1);
+            }
+            if (dp->resize.edges & EdgeTop) {
+                nh = MAX(dp->resize.oh - dy, 1);
+                ny = dp->resize.oy + dp->resize.oh - nh;
+            } else if (dp->resize.edges & EdgeBottom) {
+                nh = MAX(dp->resize.oh + dy, 1);
+            }
+        }
 
         if (
             c->mon->wx + nw >= dp->selmon->wx &&
@@ -522,7 +755,7 @@ void xi2motion(void *ev)
         if (!dp->selmon->lt[dp->selmon->sellt]->arrange || c->isfloating)
         {
             if(!c->isfullscreen)
-                resize(c, c->x, c->y, nw, nh, 1);
+                syncresize(c, nx, ny, nw, nh, e->time);
             postmoveselmon(dp, c);
         }
     }
@@ -572,8 +805,6 @@ void xi2hierarchychanged(void *ev)
     DBG("+ xi2hierarchychanged\n");
     int i, x, y, idx;
     DevPair *dp;
-    Device **pd;
-    Device *d;
     Monitor *m;
     XIHierarchyEvent *e = ev;
 
@@ -625,11 +856,7 @@ void xi2hierarchychanged(void *ev)
         if (e->info[i].flags & XISlaveDetached) {
             if (!(dp = getdevpair(deviceslots[idx].info.attachment)))
                 die("could not find device pair for slave device %d\n", deviceslots[idx].info.attachment);
-            for (pd = &dp->slaves; *pd && *pd != &deviceslots[idx]; pd = &(*pd)->snext);
-            *pd = deviceslots[idx].snext;
-            deviceslots[idx].self = NULL;
-            deviceslots[idx].snext = NULL;
-            deviceslots[idx].sprev = NULL; /* TODO: not used yet... */
+            detachslave(&deviceslots[idx]);
             DBG("detach slave: %d from master %d\n", idx, deviceslots[idx].info.use == XISlavePointer ? dp->mptr->info.deviceid : dp->mkbd->info.deviceid);
         }
     }
@@ -653,22 +880,10 @@ void xi2hierarchychanged(void *ev)
 
             if (!(dp = getdevpair(deviceslots[idx].info.attachment)))
                 die("could not find device pair for slave device %d\n", deviceslots[idx].info.attachment);
-            if (deviceslots[idx].self) {
-                for (pd = &deviceslots[idx].self->slaves; *pd && *pd != &deviceslots[idx]; pd = &(*pd)->snext);
-                *pd = deviceslots[idx].snext;
-                deviceslots[idx].self = NULL;
-                deviceslots[idx].snext = NULL;
-                deviceslots[idx].sprev = NULL; /* TODO: not used yet... */
-            }
-            if (!dp->slaves) {
-                d = &deviceslots[idx];
-                dp->slaves = d;
-            } else {
-                for (d = dp->slaves; d && d->snext; d = d->snext);
-                d->snext = &deviceslots[idx];
-            }
+            if (deviceslots[idx].self)
+                detachslave(&deviceslots[idx]);
+            attachslave(dp, &deviceslots[idx]);
             DBG("added slave: %d to master %d\n", idx, deviceslots[idx].info.use == XISlavePointer ? dp->mptr->info.deviceid : dp->mkbd->info.deviceid);
-            deviceslots[idx].self = dp;
         }
     }
 
@@ -693,11 +908,7 @@ void xi2hierarchychanged(void *ev)
         else if(deviceslots[idx].self) /* slave removal */
         {
             DBG("remove slave: %d\n", idx);
-            for (pd = &deviceslots[idx].self->slaves; *pd && *pd != &deviceslots[idx]; pd = &(*pd)->snext);
-            *pd = deviceslots[idx].snext;
-            deviceslots[idx].self = NULL;
-            deviceslots[idx].snext = NULL;
-            deviceslots[idx].sprev = NULL; /* TODO: not used yet... */
+            detachslave(&deviceslots[idx]);
         }
         
         /* detach devpair/slave from everything if mptr and mkbd is NULL */
@@ -0,0 +1,157 @@
+#include "ewmh.h"
+#include "cmds.h"
+#include "config.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * EWMH state is never written from the event handlers directly, handlers only
+ * change Client/Monitor/DevPair state. ewmhflush() runs once the event queue
+ * is drained, compares the wanted values against a shadow copy of what was
+ * last published and only touches properties that actually changed.
+ */
+
+#define DESKTOP_ALL 0xFFFFFFFFL
+
+static struct {
+    long ndesktops;
+    long curdesktop;
+    Window active;
+    int names;
+} pub;
+
+static long tagstodesktop(Tagset tags)
+{
+    tags &= TAGMASK;
+    if (!tags)
+        return 0;
+    if (gtags_len > 1 && tags == TAGMASK)
+        return DESKTOP_ALL;
+    return __builtin_ctzll(tags);
+}
+
+/* device pair that received the most recent input event */
+static DevPair *activedevpair(void)
+{
+    DevPair *dp, *r = NULL;
+
+    for (dp = gwm.devpairs; dp; dp = dp->next)
+        if (!r || dp->lastevent > r->lastevent)
+            r = dp;
+    return r;
+}
+
+/* _NET_CURRENT_DESKTOP request of a pager, views the tag on the active pair's monitor */
+void ewmhcurrentdesktop(long desktop)
+{
+    DevPair *dp = activedevpair();
+
+    if (!dp || !dp->selmon)
+        return;
+    if ((desktop & DESKTOP_ALL) == DESKTOP_ALL)
+        view(dp, &(Arg){ .t = TAGMASK });
+    else if (desktop >= 0 && desktop < (long)gtags_len)
+        view(dp, &(Arg){ .t = TAGBIT(desktop) });
+}
+
+static Window activewin(DevPair *dp)
+{
+    return (dp && dp->sel && !dp->sel->neverfocus) ? dp->sel->win : None;
+}
+
+static void publishwin(Atom atom, Window *shadow, Window w)
+{
+    if (*shadow == w)
+        return;
+    *shadow = w;
+    if (w)
+        XChangeProperty(gwm.dpy, gwm.root, atom, XA_WINDOW, 32, PropModeReplace, (unsigned char *)&w, 1);
+    else
+        XDeleteProperty(gwm.dpy, gwm.root, atom);
+}
+
+static void publishcardinal(Window w, Atom atom, long *shadow, long value)
+{
+    if (*shadow == value)
+        return;
+    *shadow = value;
+    XChangeProperty(gwm.dpy, w, atom, XA_CARDINAL, 32, PropModeReplace, (unsigned char *)&value, 1);
+}
+
+static void publishnames(void)
+{
+    char *names;
+    size_t len = 0, off = 0;
+    unsigned int i;
+
+    for (i = 0; i < gtags_len; i++)
+        len += strlen(gtags[i]) + 1;
+    names = ecalloc(1, len ? len : 1);
+    for (i = 0; i < gtags_len; i++) {
+        strcpy(&names[off], gtags[i]);
+        off += strlen(gtags[i]) + 1;
+    }
+    XChangeProperty(gwm.dpy, gwm.root, gwm.netatom[NetDesktopNames], gwm.utf8string, 8, PropModeReplace, (unsigned char *)names, len);
+    free(names);
+    pub.names = 1;
+}
+
+void ewmhinit(void)
+{
+    /* start from a known state, whatever a previous wm left behind is stale */
+    pub.ndesktops = -1;
+    pub.curdesktop = -1;
+    pub.active = None;
+    pub.names = 0;
+    XDeleteProperty(gwm.dpy, gwm.root, gwm.netatom[NetActiveWindow]);
+    ewmhflush();
+}
+
+/* publish _NET_DESKTOP_NAMES again with the next flush */
+void ewmhtagschanged(void)
+{
+    pub.names = 0;
+}
+
+void ewmhflush(void)
+{
+    char name[64];
+    DevPair *dp, *adp;
+    Monitor *m;
+    Client *c;
+
+    if (!pub.names)
+        publishnames();
+    publishcardinal(gwm.root, gwm.netatom[NetNumberOfDesktops], &pub.ndesktops, gtags_len);
+
+    adp = activedevpair();
+    if (adp && adp->selmon)
+        publishcardinal(gwm.root, gwm.netatom[NetCurrentDesktop], &pub.curdesktop,
+            tagstodesktop(adp->selmon->tagset[adp->selmon->seltags]));
+    publishwin(gwm.netatom[NetActiveWindow], &pub.active, activewin(adp));
+
+    for (dp = gwm.devpairs; dp; dp = dp->next) {
+        if (!dp->mptr)
+            continue;
+        if (!dp->netactive) {
+            snprintf(name, sizeof(name), "_MPWM_ACTIVE_WINDOW_%d", dp->mptr->info.deviceid);
+            dp->netactive = XInternAtom(gwm.dpy, name, False);
+        }
+        publishwin(dp->netactive, &dp->netactivewin, activewin(dp));
+    }
+
+    for (m = gwm.mons; m; m = m->next)
+        for (c = m->clients; c; c = c->next)
+            if (c->ismanaged)
+                publishcardinal(c->win, gwm.netatom[NetWMDesktop], &c->netdesktop, tagstodesktop(c->tags));
+}
+
+void ewmhremovedevpair(DevPair *dp)
+{
+    if (dp->netactive && dp->netactivewin)
+        XDeleteProperty(gwm.dpy, gwm.root, dp->netactive);
+    dp->netactivewin = None;
+}
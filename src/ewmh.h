@@ -0,0 +1,9 @@
+#pragma once
+
+#include "common.h"
+
+extern void ewmhinit(void);
+extern void ewmhflush(void);
+extern void ewmhtagschanged(void);
+extern void ewmhcurrentdesktop(long desktop);
+extern void ewmhremovedevpair(DevPair *dp);
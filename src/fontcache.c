@@ -0,0 +1,474 @@
+#include "fontcache.h"
+#include "config.h"
+#include "drw.h"
+#include "util.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * Fallback fonts found by fontconfig are remembered across restarts in
+ * $XDG_CACHE_HOME/mpwm/fonts. The file maps codepoints to the pattern of
+ * the font that covered them, or to "no font has it". It is mapped at
+ * startup and looked up with a binary search, so the first frames after a
+ * start open the right fonts without a single FcFontMatch(). Results of
+ * the current run are kept in memory, indexed by a hash table, and merged
+ * into a new file whenever the resolver runs out of work (at most every
+ * CACHE_WRITEDELAY seconds) and on exit.
+ *
+ * The file is only used while its key matches: a hash of gcfg.fonts, the
+ * pixel size of the primary font, the fontconfig version and the mtimes of
+ * all fontconfig configuration files and font directories. Installing or
+ * removing fonts touches a font directory and thereby changes the key.
+ */
+
+#define CACHE_MAGIC      "mpwmfc1"
+#define CACHE_MISSING    UINT32_MAX
+#define CACHE_MAXENTRIES 65536
+#define CACHE_WRITEDELAY 30 /* s */
+
+/* followed by CacheEntry[nentries] sorted by cp, uint32_t fontoff[nfonts] and the strings */
+typedef struct {
+    char magic[8];
+    uint64_t key;
+    uint32_t nentries;
+    uint32_t nfonts;
+    uint32_t strsize;
+    uint32_t pad;
+} CacheHeader;
+
+typedef struct {
+    uint32_t cp;
+    uint32_t font;        /* font index, CACHE_MISSING if no font has cp */
+} CacheEntry;
+
+/* merge input for fontcachecleanup() */
+typedef struct {
+    uint32_t cp;
+    uint32_t seq;         /* earlier ones win, this run's results come first */
+    const char *name;
+} CacheMerge;
+
+static uint64_t key;
+static void *map;
+static size_t mapsize;
+static const CacheEntry *entries;
+static const uint32_t *fontoff;
+static const char *strings;
+static uint32_t nentries, nfonts, strsize;
+
+/* results of this run, the render thread stores while the event thread may look up */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static CacheEntry *added;
+static unsigned int nadded, addedcap;
+static uint32_t *addedidx;    /* open addressing over added, index + 1, 0 is free */
+static unsigned int idxcap;   /* power of two, at least twice nadded */
+static char **addedfonts;
+static unsigned int naddedfonts, addedfontscap;
+static unsigned int nwritten; /* changes already in the file */
+static unsigned int nchanges;
+static time_t lastwrite;
+
+static void *grow(void *p, unsigned int *cap, size_t size)
+{
+    *cap = *cap ? *cap * 2 : 64;
+    if (!(p = realloc(p, *cap * size)))
+        die("realloc:");
+    return p;
+}
+
+static unsigned int cpslot(uint32_t cp)
+{
+    return (cp * 2654435761u) & (idxcap - 1);
+}
+
+static CacheEntry *addedentry(uint32_t cp)
+{
+    unsigned int i;
+
+    if (!idxcap)
+        return NULL;
+    for (i = cpslot(cp); addedidx[i]; i = (i + 1) & (idxcap - 1))
+        if (added[addedidx[i] - 1].cp == cp)
+            return &added[addedidx[i] - 1];
+    return NULL;
+}
+
+/* index added[n], the table is rebuilt twice as large when half full */
+static void indexadded(unsigned int n)
+{
+    unsigned int i, j;
+
+    if (2 * (n + 1) > idxcap) {
+        free(addedidx);
+        idxcap = idxcap ? 2 * idxcap : 256;
+        addedidx = ecalloc(idxcap, sizeof(uint32_t));
+        for (j = 0; j < n; j++) {
+            for (i = cpslot(added[j].cp); addedidx[i]; i = (i + 1) & (idxcap - 1));
+            addedidx[i] = j + 1;
+        }
+    }
+    for (i = cpslot(added[n].cp); addedidx[i]; i = (i + 1) & (idxcap - 1));
+    addedidx[i] = n + 1;
+}
+
+/* $XDG_CACHE_HOME/mpwm/fonts, the directories are created on request */
+static int cachepath(char *buf, size_t size, int create)
+{
+    const char *xdg = getenv("XDG_CACHE_HOME"), *home = getenv("HOME");
+    char *p;
+    int n;
+
+    if (xdg && *xdg)
+        n = snprintf(buf, size, "%s/mpwm/fonts", xdg);
+    else if (home && *home)
+        n = snprintf(buf, size, "%s/.cache/mpwm/fonts", home);
+    else
+        return 0;
+    if (n < 0 || (size_t)n >= size)
+        return 0;
+
+    for (p = buf + 1; create && (p = strchr(p, '/')); p++) {
+        *p = '\0';
+        if (mkdir(buf, 0700) < 0 && errno != EEXIST) {
+            *p = '/';
+            return 0;
+        }
+        *p = '/';
+    }
+    return 1;
+}
+
+static uint64_t hashstrlist(uint64_t hash, FcStrList *l)
+{
+    FcChar8 *s;
+    struct stat st;
+
+    if (!l)
+        return hash;
+    while ((s = FcStrListNext(l))) {
+        hash = hashbytes(hash, s, strlen((char *)s) + 1);
+        if (!stat((char *)s, &st)) {
+            hash = hashbytes(hash, &st.st_mtime, sizeof(st.st_mtime));
+            hash = hashbytes(hash, &st.st_size, sizeof(st.st_size));
+        }
+    }
+    FcStrListDone(l);
+    return hash;
+}
+
+static uint64_t cachekey(void)
+{
+    uint64_t hash = HASH_INIT;
+    unsigned int i;
+    double px = 0;
+    int version = FcGetVersion();
+
+    hash = hashbytes(hash, &version, sizeof(version));
+    for (i = 0; i < gcfg.fonts_len; i++)
+        hash = hashbytes(hash, gcfg.fonts[i], strlen(gcfg.fonts[i]) + 1);
+    if (gdrw && gdrw->fonts)
+        FcPatternGetDouble(gdrw->fonts->xfont->pattern, FC_PIXEL_SIZE, 0, &px);
+    hash = hashbytes(hash, &px, sizeof(px));
+    hash = hashstrlist(hash, FcConfigGetConfigFiles(NULL));
+    hash = hashstrlist(hash, FcConfigGetFontDirs(NULL));
+    return hash;
+}
+
+static void unmapcache(void)
+{
+    if (map)
+        munmap(map, mapsize);
+    map = NULL;
+    mapsize = 0;
+    entries = NULL;
+    fontoff = NULL;
+    strings = NULL;
+    nentries = nfonts = strsize = 0;
+}
+
+void fontcacheinit(void)
+{
+    char path[PATH_MAX];
+    const CacheHeader *h;
+    struct stat st;
+    size_t need;
+    int fd;
+
+    key = cachekey();
+    if (!cachepath(path, sizeof(path), 0) || (fd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+        return;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(CacheHeader)) {
+        close(fd);
+        return;
+    }
+    /* populated right away, lookups during the first frames must not fault */
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        map = NULL;
+        return;
+    }
+    mapsize = st.st_size;
+
+    h = map;
+    need = sizeof(CacheHeader) + (size_t)h->nentries * sizeof(CacheEntry)
+        + (size_t)h->nfonts * sizeof(uint32_t) + h->strsize;
+    if (memcmp(h->magic, CACHE_MAGIC, sizeof(h->magic)) || h->key != key || need != mapsize
+    || (h->strsize && ((const char *)map)[mapsize - 1])) {
+        DBG("fontcacheinit: ignoring stale %s\n", path);
+        unmapcache();
+        return;
+    }
+    nentries = h->nentries;
+    nfonts = h->nfonts;
+    strsize = h->strsize;
+    entries = (const CacheEntry *)(h + 1);
+    fontoff = (const uint32_t *)(entries + nentries);
+    strings = (const char *)(fontoff + nfonts);
+}
+
+/* pattern string of the font an entry refers to, NULL for a corrupt entry */
+static const char *mappedname(const CacheEntry *e)
+{
+    if (e->font >= nfonts || fontoff[e->font] >= strsize)
+        return NULL;
+    return strings + fontoff[e->font];
+}
+
+static const CacheEntry *mappedentry(uint32_t cp)
+{
+    uint32_t lo = 0, hi = nentries, mid;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (entries[mid].cp < cp)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo < nentries && entries[lo].cp == cp ? &entries[lo] : NULL;
+}
+
+/* 1 and a pattern to open if a font is known to cover cp, -1 if none does, 0 if unknown */
+int fontcachelookup(long cp, FcPattern **match)
+{
+    const CacheEntry *e;
+    const char *name = NULL;
+    int ret = 0;
+
+    pthread_mutex_lock(&lock);
+    if ((e = addedentry(cp)))
+        name = e->font == CACHE_MISSING ? NULL : addedfonts[e->font];
+    else if ((e = mappedentry(cp)) && e->font != CACHE_MISSING)
+        name = mappedname(e);
+
+    if (e && e->font == CACHE_MISSING)
+        ret = -1;
+    else if (name && (*match = FcNameParse((const FcChar8 *)name)))
+        ret = 1;
+    pthread_mutex_unlock(&lock);
+    return ret;
+}
+
+void fontcachestore(long cp, const FcPattern *match)
+{
+    FcPattern *p;
+    FcChar8 *name = NULL;
+    CacheEntry *e;
+    unsigned int i, font = CACHE_MISSING;
+
+    if (match) {
+        /* the coverage is read from the face again when the font is opened */
+        p = FcPatternDuplicate(match);
+        FcPatternDel(p, FC_CHARSET);
+        FcPatternDel(p, FC_LANG);
+        name = FcNameUnparse(p);
+        FcPatternDestroy(p);
+        if (!name)
+            return;
+    }
+
+    pthread_mutex_lock(&lock);
+    if ((e = addedentry(cp)) || nadded < CACHE_MAXENTRIES) {
+        if (name) {
+            for (i = 0; i < naddedfonts && strcmp(addedfonts[i], (char *)name); i++);
+            if (i == naddedfonts) {
+                if (naddedfonts == addedfontscap)
+                    addedfonts = grow(addedfonts, &addedfontscap, sizeof(char *));
+                addedfonts[naddedfonts++] = strdup((char *)name);
+            }
+            font = i;
+        }
+        if (e) {
+            e->font = font;
+        } else {
+            if (nadded == addedcap)
+                added = grow(added, &addedcap, sizeof(CacheEntry));
+            added[nadded] = (CacheEntry){ cp, font };
+            indexadded(nadded++);
+        }
+        nchanges++;
+    }
+    pthread_mutex_unlock(&lock);
+    if (name)
+        FcStrFree(name);
+}
+
+static int cmpmerge(const void *a, const void *b)
+{
+    const CacheMerge *ma = a, *mb = b;
+
+    if (ma->cp != mb->cp)
+        return (ma->cp > mb->cp) - (ma->cp < mb->cp);
+    return (ma->seq > mb->seq) - (ma->seq < mb->seq);
+}
+
+static int writecache(const char *path, CacheMerge *m, unsigned int n)
+{
+    CacheHeader h = { .magic = CACHE_MAGIC, .key = key };
+    CacheEntry e;
+    const char **names;
+    uint32_t *offs, off = 0;
+    char tmp[PATH_MAX + 16];
+    unsigned int i, j, nnames = 0;
+    FILE *f;
+    int ok;
+
+    names = ecalloc(n + 1, sizeof(char *));
+    offs = ecalloc(n + 1, sizeof(uint32_t));
+    for (i = 0; i < n; i++) {
+        if (!m[i].name)
+            continue;
+        for (j = 0; j < nnames && strcmp(names[j], m[i].name); j++);
+        if (j == nnames) {
+            names[nnames] = m[i].name;
+            offs[nnames++] = off;
+            off += strlen(m[i].name) + 1;
+        }
+    }
+    h.nentries = n;
+    h.nfonts = nnames;
+    h.strsize = off;
+
+    snprintf(tmp, sizeof(tmp), "%s.%d", path, (int)getpid());
+    if (!(f = fopen(tmp, "wb"))) {
+        free(names);
+        free(offs);
+        return 0;
+    }
+    ok = fwrite(&h, sizeof(h), 1, f) == 1;
+    for (i = 0; ok && i < n; i++) {
+        e.cp = m[i].cp;
+        e.font = CACHE_MISSING;
+        for (j = 0; m[i].name && j < nnames; j++)
+            if (!strcmp(names[j], m[i].name)) {
+                e.font = j;
+                break;
+            }
+        ok = fwrite(&e, sizeof(e), 1, f) == 1;
+    }
+    ok = ok && (!nnames || fwrite(offs, sizeof(uint32_t), nnames, f) == nnames);
+    for (i = 0; ok && i < nnames; i++)
+        ok = fwrite(names[i], strlen(names[i]) + 1, 1, f) == 1;
+    ok = !fclose(f) && ok;
+    free(names);
+    free(offs);
+
+    if (!ok || rename(tmp, path) < 0) {
+        unlink(tmp);
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * this run's results followed by the mapped file's, sorted by codepoint with
+ * one entry each, called with the lock held. The names stay valid until
+ * fontcachecleanup().
+ */
+static unsigned int mergeentries(CacheMerge **out)
+{
+    CacheMerge *m;
+    unsigned int i, n = 0, kept = 0;
+
+    m = ecalloc(nadded + nentries + 1, sizeof(CacheMerge));
+    for (i = 0; i < nadded; i++, n++)
+        m[n] = (CacheMerge){ added[i].cp, n, added[i].font == CACHE_MISSING ? NULL : addedfonts[added[i].font] };
+    for (i = 0; i < nentries; i++) {
+        if (entries[i].font != CACHE_MISSING && !mappedname(&entries[i]))
+            continue;
+        m[n] = (CacheMerge){ entries[i].cp, n, entries[i].font == CACHE_MISSING ? NULL : mappedname(&entries[i]) };
+        n++;
+    }
+    qsort(m, n, sizeof(CacheMerge), cmpmerge);
+    for (i = 0; i < n && kept < CACHE_MAXENTRIES; i++)
+        if (!kept || m[kept - 1].cp != m[i].cp)
+            m[kept++] = m[i];
+    *out = m;
+    return kept;
+}
+
+/*
+ * write the results found so far, called when the resolver has nothing left
+ * to look up. The file is written outside of the lock so lookups of the
+ * render thread do not wait for the disk.
+ */
+void fontcachesync(void)
+{
+    char path[PATH_MAX];
+    CacheMerge *m;
+    unsigned int n;
+    time_t now = time(NULL);
+
+    pthread_mutex_lock(&lock);
+    if (nchanges == nwritten || now - lastwrite < CACHE_WRITEDELAY || !cachepath(path, sizeof(path), 1)) {
+        pthread_mutex_unlock(&lock);
+        return;
+    }
+    n = mergeentries(&m);
+    nwritten = nchanges;
+    lastwrite = now;
+    pthread_mutex_unlock(&lock);
+
+    if (!writecache(path, m, n))
+        fprintf(stderr, "mpwm: cannot write font cache %s\n", path);
+    free(m);
+}
+
+/* merge this run's results into the cache file and release everything */
+void fontcachecleanup(void)
+{
+    char path[PATH_MAX];
+    CacheMerge *m;
+    unsigned int i, n;
+
+    pthread_mutex_lock(&lock);
+    if (nchanges != nwritten && cachepath(path, sizeof(path), 1)) {
+        n = mergeentries(&m);
+        if (!writecache(path, m, n))
+            fprintf(stderr, "mpwm: cannot write font cache %s\n", path);
+        free(m);
+    }
+
+    for (i = 0; i < naddedfonts; i++)
+        free(addedfonts[i]);
+    free(addedfonts);
+    free(added);
+    free(addedidx);
+    addedfonts = NULL;
+    added = NULL;
+    addedidx = NULL;
+    naddedfonts = addedfontscap = nadded = addedcap = idxcap = 0;
+    nchanges = nwritten = 0;
+    unmapcache();
+    pthread_mutex_unlock(&lock);
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include "common.h"
+
+extern void fontcacheinit(void);
+extern void fontcachecleanup(void);
+extern void fontcachesync(void);
+extern int fontcachelookup(long cp, FcPattern **match);
+extern void fontcachestore(long cp, const FcPattern *match);
@@ -2,6 +2,8 @@
 #include "config.h"
 #include "client.h"
 
+/* the layouts place m->tiled, arrangemon() brings it up to date */
+
 const Layout glayouts[] = {
     /* symbol     arrange function */
     { "[]=",      tile },    /* first entry is default */
@@ -13,11 +15,9 @@ const unsigned int glayouts_len = LENGTH(glayouts);
 
 void tile(Monitor *m)
 {
-    int h, r, mw, my, ty, i, n, oe = 1, ie = 1;
+    int h, r, mw, my, ty, i, n = m->ntiled, oe = 1, ie = 1;
     Client *c;
 
-    for (n = 0, c = nexttiled(m->clients); c; c = nexttiled(c->next), n++);
-
     if (n == 0)
         return;
 
@@ -26,7 +26,8 @@ void tile(Monitor *m)
     else
         mw = m->ww - 2 * gcfg.gappx * oe + gcfg.gappx * ie;
     
-    for (i = 0, my = ty = gcfg.gappx * oe, c = nexttiled(m->clients); c; c = nexttiled(c->next), i++) {
+    for (i = 0, my = ty = gcfg.gappx * oe; i < n; i++) {
+        c = m->tiled[i];
         if (i < m->nmaster) {
             r = MIN(n, m->nmaster) - i;
             h = (m->wh - my - gcfg.gappx * oe - gcfg.gappx * ie * (r - 1)) / r;
@@ -43,26 +44,23 @@ void tile(Monitor *m)
 
 void monocle(Monitor *m)
 {
-    unsigned int n = 0;
     Client *c;
+    int i;
 
-    for (c = m->clients; c; c = c->next)
-        if (ISVISIBLE(c))
-            n++;
-    if (n > 0) /* override layout symbol */
-        snprintf(m->ltsymbol, sizeof(m->ltsymbol), "[%d]", n);
-    for (c = nexttiled(m->clients); c; c = nexttiled(c->next))
+    if (m->nvisible > 0) /* override layout symbol */
+        snprintf(m->ltsymbol, sizeof(m->ltsymbol), "[%d]", m->nvisible);
+    for (i = 0; i < m->ntiled; i++) {
+        c = m->tiled[i];
         resize(c, m->wx, m->wy, m->ww - 2 * c->bw, m->wh - 2 * c->bw, 0);
+    }
 }
 
 void centeredmaster(Monitor *m)
 {
     int h, mw, mx, my, oty, ety, tw;
-    int i, n, nm;
+    int i, n = m->ntiled, nm;
     Client *c;
 
-    /* count number of clients in the selected monitor */
-    for (n = 0, c = nexttiled(m->clients); c; c = nexttiled(c->next), n++);
     if (n == 0)
         return;
 
@@ -89,26 +87,28 @@ void centeredmaster(Monitor *m)
 
     oty = 0;
     ety = 0;
-    for (i = 0, c = nexttiled(m->clients); c; c = nexttiled(c->next), i++)
-    if (i < nm) {
-        /* nmaster clients are stacked vertically, in the center
-         * of the screen */
-        h = (m->wh - my) / (MIN(n, nm) - i);
-        resize(c, m->wx + mx, m->wy + my, mw - (2*c->bw),
-               h - (2*c->bw), 0);
-        my += HEIGHT(c);
-    } else {
-        /* stack clients are stacked vertically */
-        if ((i - nm) % 2 ) {
-            h = (m->wh - ety) / ( (1 + n - i) / 2);
-            resize(c, m->wx, m->wy + ety, tw - (2*c->bw),
+    for (i = 0; i < n; i++) {
+        c = m->tiled[i];
+        if (i < nm) {
+            /* nmaster clients are stacked vertically, in the center
+             * of the screen */
+            h = (m->wh - my) / (MIN(n, nm) - i);
+            resize(c, m->wx + mx, m->wy + my, mw - (2*c->bw),
                    h - (2*c->bw), 0);
-            ety += HEIGHT(c);
+            my += HEIGHT(c);
         } else {
-            h = (m->wh - oty) / ((1 + n - i) / 2);
-            resize(c, m->wx + mx + mw, m->wy + oty,
-                   tw - (2*c->bw), h - (2*c->bw), 0);
-            oty += HEIGHT(c);
+            /* stack clients are stacked vertically */
+            if ((i - nm) % 2 ) {
+                h = (m->wh - ety) / ( (1 + n - i) / 2);
+                resize(c, m->wx, m->wy + ety, tw - (2*c->bw),
+                       h - (2*c->bw), 0);
+                ety += HEIGHT(c);
+            } else {
+                h = (m->wh - oty) / ((1 + n - i) / 2);
+                resize(c, m->wx + mx + mw, m->wy + oty,
+                       tw - (2*c->bw), h - (2*c->bw), 0);
+                oty += HEIGHT(c);
+            }
         }
     }
 }
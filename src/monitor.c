@@ -1,19 +1,80 @@
 #include "monitor.h"
+#include "barrender.h"
+#include "barwin.h"
+#include "config.h"
+#include "ewmh.h"
+#include "resolvers.h"
 #include "util.h"
 #include "client.h"
 #include "events.h"
+#include "xstate.h"
 
-void showhide(Client *c)
+#include <stdlib.h>
+
+static unsigned long gathergen;
+static Client **hidden;
+static int hiddencap;
+
+static void growclients(Client ***a, int *cap, int n)
 {
-    if (!c)
+    if (n < *cap)
         return;
+    *cap = *cap ? 2 * *cap : 16;
+    if (!(*a = realloc(*a, *cap * sizeof(Client *))))
+        die("realloc:");
+}
 
-    if (ISVISIBLE(c))
-    {
-        /* show clients top down */
+/* the clients of m that have one of tags, each once, in no particular order */
+static int gather(Monitor *m, Tagset tags, Client ***a, int *cap)
+{
+    unsigned long gen = ++gathergen;
+    unsigned int i, j;
+    Client *c;
+    int n = 0;
+
+    for (tags &= m->occ; tags; tags &= tags - 1) {
+        i = __builtin_ctzll(tags);
+        for (j = 0; j < m->tagocc[i]; j++) {
+            c = m->tagclients[i][j];
+            if (c->gathered == gen)
+                continue;
+            c->gathered = gen;
+            growclients(a, cap, n);
+            (*a)[n++] = c;
+        }
+    }
+    return n;
+}
+
+static int cmporder(const void *a, const void *b)
+{
+    long x = (*(Client *const *)a)->order, y = (*(Client *const *)b)->order;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * visibility only changes the wanted position, commit() moves the windows.
+ * Only the clients of the tags shown before or viewed now are visited,
+ * counttags() marks clients that were retagged or moved on its own.
+ */
+static void showhide(Monitor *m)
+{
+    Tagset tags = m->tagset[m->seltags];
+    Client *c;
+    int i, n;
+
+    if (m->shown & ~tags) {
+        n = gather(m, m->shown & ~tags, &hidden, &hiddencap);
+        for (i = 0; i < n; i++)
+            markdirty(hidden[i]);
+    }
+    updatetiled(m);
+    for (i = 0; i < m->nvisible; i++) {
+        c = m->visible[i];
         DBG("+showhide %lu\n", c->win);
-        XMoveWindow(gwm.dpy, c->win, c->x, c->y);
-        if ((!c->mon->lt[c->mon->sellt]->arrange || c->isfloating))
+        markdirty(c);
+        if (!m->lt[m->sellt]->arrange || c->isfloating)
         {
             resize(c, c->x, c->y, c->w, c->h, 0);
             if (c->isfullscreen)
@@ -21,15 +82,9 @@ void showhide(Client *c)
                 setfullscreen(c, 1);
             }
         }
-        showhide(c->snext);
-    }
-    else
-    {
-        DBG("+showhide %lu\n", c->win);
-        /* hide clients bottom up */
-        showhide(c->snext);
-        XMoveWindow(gwm.dpy, c->win, WIDTH(c) * -2, c->y);
     }
+    m->shown = tags;
+    gwm.stackdirty = 1;
 }
 
 void arrange(Monitor *m)
@@ -44,10 +99,10 @@ void arrange(Monitor *m)
     DBG("+arrange\n");
 
     if (m)
-        showhide(m->stack);
+        showhide(m);
     else
         for (m = gwm.mons; m; m = m->next)
-            showhide(m->stack);
+            showhide(m);
     
     if (m)
         arrangemon(m);
@@ -55,6 +110,8 @@ void arrange(Monitor *m)
         for (m = gwm.mons; m; m = m->next)
             arrangemon(m);
 
+    commit();
+
     if(m->arranging_clients)
     {
         while (XCheckTypedEvent(gwm.dpy, GenericEvent, &ev)) {
@@ -68,10 +125,70 @@ void arrangemon(Monitor *m)
 {
     DBG("+arrangemon\n");
     strncpy(m->ltsymbol, m->lt[m->sellt]->symbol, sizeof(m->ltsymbol) - 1);
+    updatetiled(m);
     if (m->lt[m->sellt]->arrange)
         m->lt[m->sellt]->arrange(m);
 }
 
+/*
+ * collect the visible clients and the tiled ones among them for the layouts,
+ * only after a visible client or the viewed tags changed. The per tag arrays
+ * hold exactly the clients of each tag, so hidden clients are never visited.
+ */
+void updatetiled(Monitor *m)
+{
+    Tagset tags = m->tagset[m->seltags];
+    int i;
+
+    if (!m->tileddirty && m->tiledtags == tags)
+        return;
+    m->nvisible = gather(m, tags, &m->visible, &m->visiblecap);
+    if (m->nvisible > 1)
+        qsort(m->visible, m->nvisible, sizeof(Client *), cmporder);
+    m->ntiled = 0;
+    for (i = 0; i < m->nvisible; i++)
+        if (!m->visible[i]->isfloating) {
+            growclients(&m->tiled, &m->tiledcap, m->ntiled);
+            m->tiled[m->ntiled++] = m->visible[i];
+        }
+    m->tiledtags = tags;
+    m->tileddirty = 0;
+}
+
+/* the visible client that was focused last, NULL if there is none */
+Client *topvisible(Monitor *m)
+{
+    Client *c = NULL;
+    int i;
+
+    updatetiled(m);
+    for (i = 0; i < m->nvisible; i++)
+        if (m->visible[i]->stackpos && (!c || m->visible[i]->stackpos < c->stackpos))
+            c = m->visible[i];
+    return c;
+}
+
+/* fit viewed tags and clients into gtags after it was read again */
+void updatetags(void)
+{
+    Monitor *m;
+    Client *c;
+    int i;
+
+    for (m = gwm.mons; m; m = m->next) {
+        for (i = 0; i < 2; i++)
+            if (!(m->tagset[i] &= TAGMASK))
+                m->tagset[i] = TAGBIT(0);
+        for (c = m->clients; c; c = c->next)
+            if (c->tags & ~TAGMASK)
+                settags(c, c->tags & TAGMASK ? c->tags & TAGMASK : m->tagset[m->seltags]);
+        markbar(m);
+    }
+    ewmhtagschanged();
+    for (m = gwm.mons; m; m = m->next)
+        arrange(m);
+}
+
 void insertmon(Monitor *at, Monitor *m)
 {
     if(!at && gwm.mons) /* infront of mons */
@@ -98,6 +215,7 @@ void insertmon(Monitor *at, Monitor *m)
     {
         gwm.mons_end = m;
     }
+    topologychanged();
 }
 
 void unlinkmon(Monitor *m)
@@ -114,13 +232,24 @@ void unlinkmon(Monitor *m)
     
     m->next = NULL;
     m->prev = NULL;
+    topologychanged();
 }
 
 void cleanupmon(Monitor *m)
 {
+    int i;
+
     unlinkmon(m);
 
+    unindexwin(m->barwin);
     XUnmapWindow(gwm.dpy, m->barwin);
     XDestroyWindow(gwm.dpy, m->barwin);
+    if (m->barslot)
+        barslotrelease(m->barslot);
+    free(m->bartitle);
+    free(m->tiled);
+    free(m->visible);
+    for (i = 0; i < MAXTAGS; i++)
+        free(m->tagclients[i]);
     free(m);
 }
@@ -5,6 +5,9 @@
 extern Monitor *createmon(void);
 extern void arrange(Monitor *m);
 extern void arrangemon(Monitor *m);
+extern void updatetiled(Monitor *m);
+extern Client *topvisible(Monitor *m);
+extern void updatetags(void);
 extern void insertmon(Monitor *at, Monitor *m);
 extern void unlinkmon(Monitor *m);
 extern void cleanupmon(Monitor *m);
\ No newline at end of file
@@ -22,6 +22,7 @@
  */
 #include <X11/X.h>
 #include <locale.h>
+#include <poll.h>
 #include <signal.h>
 #include <stdarg.h>
 #include <stdint.h>
@@ -46,10 +47,20 @@
 #include "cmds.h"
 #include "events.h"
 #include "barwin.h"
+#include "barrender.h"
+#include "fontcache.h"
 #include "devpair.h"
 #include "monitor.h"
 #include "client.h"
 #include "layouts.h"
+#include "ewmh.h"
+#include "resolvers.h"
+#include "xstate.h"
+#include "resizesync.h"
+#ifdef COMPOSITOR
+#include "comp.h"
+#include "overview.h"
+#endif
 
 #include "drw.h"
 #include "util.h"
@@ -98,7 +109,7 @@ void checkotherwm(void)
 
 void cleanup(void)
 {
-    Arg a = {.ui = ~0};
+    Arg a = {.t = ~(Tagset)0};
     Layout foo = { "", NULL };
     Monitor *m;
     size_t i;
@@ -116,6 +127,8 @@ void cleanup(void)
     for (m = gwm.mons; m; m = m->next)
         while (m->stack)
             unmanage(m->stack, 0);
+    while (gwm.popups)
+        unmanagepopup(gwm.popups, 0);
     
     XIUngrabKeycode(gwm.dpy, XIAllMasterDevices, XIAnyKeycode, gwm.root, ganymodifier_len, ganymodifier);
 
@@ -133,7 +146,14 @@ void cleanup(void)
 
     free(gwm.ff_scheme);
     free(gwm.scheme);
+#ifdef COMPOSITOR
+    overviewcleanup();
+    compcleanup(); /* gives up the selection owned by wmcheckwin */
+#endif
     XDestroyWindow(gwm.dpy, gwm.wmcheckwin);
+    freewinindex();
+    barrendercleanup();
+    fontcachecleanup();
     drw_free(gdrw);
     XSync(gwm.dpy, False);
     XISetFocus(gwm.dpy, XIAllMasterDevices, None, CurrentTime);
@@ -205,9 +225,36 @@ void run(void)
     gwm.running = 1;
 
     XEvent ev;
+    struct pollfd pfd = { .fd = ConnectionNumber(gwm.dpy), .events = POLLIN };
+    int wait, syncwait;
     /* main event loop */
     XSync(gwm.dpy, False);
-    while (gwm.running && !XNextEvent(gwm.dpy, &ev)) {
+    while (gwm.running) {
+        /* apply and publish state once per batch, when the queue has been drained */
+        if (!XEventsQueued(gwm.dpy, QueuedAfterReading)) {
+            syncwait = syncflush();
+            commit();
+            wait = flushbars();
+            ewmhflush();
+#ifdef COMPOSITOR
+            overviewflush();
+            compflush();
+#endif
+            /* a bar held back by the rate cap is drawn when nothing else comes in,
+             * a resize the client did not answer is sent after the timeout */
+            if (syncwait >= 0 && (wait < 0 || syncwait < wait))
+                wait = syncwait;
+            if (wait >= 0) {
+                XFlush(gwm.dpy);
+                /* round trips of the flushes may have read events into the
+                 * queue already, the socket would not wake the poll for them */
+                if (!XEventsQueued(gwm.dpy, QueuedAlready))
+                    poll(&pfd, 1, wait);
+                continue;
+            }
+        }
+        if (XNextEvent(gwm.dpy, &ev))
+            break;
         fire_event(ev.type, &ev);
     }
 }
@@ -251,7 +298,6 @@ void setup(void)
 {
     uint32_t i;
     XSetWindowAttributes wa;
-    Atom utf8string;
     struct sigaction sa;
 
 #ifdef DEBUG
@@ -285,7 +331,7 @@ void setup(void)
     gwm.sh = DisplayHeight(gwm.dpy, gwm.screen);
     gwm.root = RootWindow(gwm.dpy, gwm.screen);
 
-    gdrw = drw_create(gwm.dpy, gwm.screen, gwm.root, gwm.sw, gwm.sh);
+    gdrw = drw_create(gwm.dpy, gwm.screen, gwm.root, 0, 0); /* bars bring their own pixmaps */
     if (!drw_fontset_create(gdrw, gcfg.fonts, gcfg.fonts_len))
         die("no fonts could be loaded.");
 
@@ -294,7 +340,7 @@ void setup(void)
     updategeom(NULL);
 
     /* init atoms */
-    utf8string = Dbg_XInternAtom("UTF8_STRING", False);
+    gwm.utf8string = Dbg_XInternAtom("UTF8_STRING", False);
     gwm.wmatom[WMProtocols] = Dbg_XInternAtom("WM_PROTOCOLS", False);
     gwm.wmatom[WMIgnoreEnter] = Dbg_XInternAtom("WM_IGNORE_ENTER", False);
     gwm.wmatom[WMNormalEnter] = Dbg_XInternAtom("WM_NORMAL_ENTER", False);
@@ -311,7 +357,18 @@ void setup(void)
     gwm.netatom[NetWMWindowTypeDialog] = Dbg_XInternAtom("_NET_WM_WINDOW_TYPE_DIALOG", False);
     gwm.netatom[NetWMTooltip] = Dbg_XInternAtom("_NET_WM_WINDOW_TYPE_TOOLTIP", False);
     gwm.netatom[NetWMPopupMenu] = Dbg_XInternAtom("_NET_WM_WINDOW_TYPE_POPUP_MENU", False);
+    gwm.netatom[NetWMDropdownMenu] = Dbg_XInternAtom("_NET_WM_WINDOW_TYPE_DROPDOWN_MENU", False);
+    gwm.netatom[NetWMNotification] = Dbg_XInternAtom("_NET_WM_WINDOW_TYPE_NOTIFICATION", False);
+    gwm.netatom[NetWMUtility] = Dbg_XInternAtom("_NET_WM_WINDOW_TYPE_UTILITY", False);
+    gwm.netatom[NetWMMoveResize] = Dbg_XInternAtom("_NET_WM_MOVERESIZE", False);
+    gwm.netatom[NetMoveResizeWindow] = Dbg_XInternAtom("_NET_MOVERESIZE_WINDOW", False);
+    gwm.netatom[NetWMSyncRequest] = Dbg_XInternAtom("_NET_WM_SYNC_REQUEST", False);
+    gwm.netatom[NetWMSyncRequestCounter] = Dbg_XInternAtom("_NET_WM_SYNC_REQUEST_COUNTER", False);
     gwm.netatom[NetClientList] = Dbg_XInternAtom("_NET_CLIENT_LIST", False);
+    gwm.netatom[NetNumberOfDesktops] = Dbg_XInternAtom("_NET_NUMBER_OF_DESKTOPS", False);
+    gwm.netatom[NetCurrentDesktop] = Dbg_XInternAtom("_NET_CURRENT_DESKTOP", False);
+    gwm.netatom[NetDesktopNames] = Dbg_XInternAtom("_NET_DESKTOP_NAMES", False);
+    gwm.netatom[NetWMDesktop] = Dbg_XInternAtom("_NET_WM_DESKTOP", False);
 
     /* init cursors */
     gwm.cursor[CurNormal] = drw_cur_create(gdrw, XC_left_ptr);
@@ -328,16 +385,20 @@ void setup(void)
         gwm.ff_scheme[i] = drw_scm_create(gdrw, ff_colors[i], LENGTH(*ff_colors));
 
     /* init bars */
+    fontcacheinit();
+    barrenderinit();
     updatebars();
     updatestatus();
     /* supporting window for NetWMCheck */
     gwm.wmcheckwin = XCreateSimpleWindow(gwm.dpy, gwm.root, 0, 0, 1, 1, 0, 0, 0);
+    indexwin(gwm.wmcheckwin, WinHelper, NULL);
     XChangeProperty(gwm.dpy, gwm.wmcheckwin, gwm.netatom[NetWMCheck], XA_WINDOW, 32, PropModeReplace, (unsigned char *) &gwm.wmcheckwin, 1);
-    XChangeProperty(gwm.dpy, gwm.wmcheckwin, gwm.netatom[NetWMName], utf8string, 8, PropModeReplace, (unsigned char *) "mpwm", 4);
+    XChangeProperty(gwm.dpy, gwm.wmcheckwin, gwm.netatom[NetWMName], gwm.utf8string, 8, PropModeReplace, (unsigned char *) "mpwm", 4);
     XChangeProperty(gwm.dpy, gwm.root, gwm.netatom[NetWMCheck], XA_WINDOW, 32, PropModeReplace, (unsigned char *) &gwm.wmcheckwin, 1);
     /* EWMH support per view */
     XChangeProperty(gwm.dpy, gwm.root, gwm.netatom[NetSupported], XA_ATOM, 32, PropModeReplace, (unsigned char *) gwm.netatom, NetLast);
     XDeleteProperty(gwm.dpy, gwm.root, gwm.netatom[NetClientList]);
+    ewmhinit();
     /* set cursor on root window */
     XDefineCursor(gwm.dpy, gwm.root, gwm.cursor[CurNormal]->cursor);
     /* select events */
@@ -354,6 +415,9 @@ void setup(void)
     
     /* get device map */
     initdevices();
+#ifdef COMPOSITOR
+    compinit();
+#endif
 }
 
 void test_config(void)
@@ -390,12 +454,15 @@ int main(int argc, char *argv[])
         die("usage: mpwm [-v]");
     if (!setlocale(LC_CTYPE, "") || !XSupportsLocale())
         fputs("warning: no locale support\n", stderr);
+    /* bars are rendered on a second connection from another thread */
+    XInitThreads();
     if (!(gwm.dpy = XOpenDisplay(NULL)))
         die("mpwm: cannot open display");
     if (!XQueryExtension(gwm.dpy, "XInputExtension", &gwm.xi2opcode, &(int){0}, &(int){0}))
         die("XInputExtension not available.\n");
     if (XIQueryVersion(gwm.dpy, &major, &minor) == BadRequest)
         die("XInput 2.0 not available. Server only supports %d.%d\n", major, minor);
+    syncinit();
 
     checkotherwm();
     setup();
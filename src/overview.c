@@ -0,0 +1,364 @@
+#include "overview.h"
+#include "barrender.h"
+#include "comp.h"
+#include "config.h"
+#include "devpair.h"
+#include "monitor.h"
+#include "resolvers.h"
+#include "util.h"
+
+#include <X11/extensions/Xrender.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Overview of every client, one block per monitor with a row per tag (a
+ * client is listed under the lowest of its tags). Thumbnails are scaled down
+ * from the compositor's window pixmaps with an XRender transform, hidden
+ * clients included, so nothing has to redraw for the overview. They are
+ * cached across openings and scaled again only when the window was damaged
+ * (its compframe() serial changed) or its cell changed size.
+ *
+ * The overview shows the clients present when it was opened. A click on a
+ * thumbnail views its tag and focuses it with a single arrange(), anywhere
+ * else the overview is closed.
+ *
+ * Tag names are child windows drawn by the bar renderer whenever they are
+ * exposed, the event thread never measures or draws text here. Everything
+ * else is drawn and copied to the window with plain XRender, not gdrw.
+ */
+
+#define PAD 8
+
+typedef struct {
+    Window win;
+    Tagset tag;           /* tag bit it is listed under */
+    int x, y, w, h;       /* cell in the overview */
+    Pixmap pix;           /* cached thumbnail */
+    Picture pict;
+    int tw, th;
+    unsigned int serial;  /* of the frame it was scaled from */
+} Thumb;
+
+typedef struct {
+    Window win;
+    int tag;
+    int sel;              /* tag is viewed on its monitor */
+    int w;
+} Label;
+
+static Thumb *thumbs;
+static int nthumbs;
+static Label *labels;
+static int nlabels;
+static Window ovwin;
+static Pixmap ovpix;
+static Picture ovpict;
+static Picture ovwinpict;
+
+static void freethumb(Thumb *t)
+{
+    if (t->pict)
+        XRenderFreePicture(gwm.dpy, t->pict);
+    if (t->pix)
+        XFreePixmap(gwm.dpy, t->pix);
+    t->pict = None;
+    t->pix = None;
+}
+
+/* take over the cached thumbnail of win from the previous layout */
+static void reuse(Thumb *t, Thumb *old, int nold)
+{
+    int i;
+
+    for (i = 0; i < nold; i++)
+        if (old[i].win == t->win && old[i].pict) {
+            t->pix = old[i].pix;
+            t->pict = old[i].pict;
+            t->tw = old[i].tw;
+            t->th = old[i].th;
+            t->serial = old[i].serial;
+            old[i].pix = old[i].pict = None;
+            return;
+        }
+}
+
+static void layout(void)
+{
+    unsigned int count[MAXTAGS], seen[MAXTAGS], i;
+    Tagset rows;
+    int n = 0, nold = nthumbs, nrows, rowh, cellw;
+    Thumb *old = thumbs, *t;
+    Monitor *m;
+    Client *c;
+
+    for (m = gwm.mons; m; m = m->next)
+        for (c = m->clients; c; c = c->next)
+            n++;
+    thumbs = ecalloc(MAX(n, 1), sizeof(Thumb));
+    nthumbs = 0;
+    for (m = gwm.mons; m; m = m->next) {
+        rows = 0;
+        memset(count, 0, sizeof(count));
+        memset(seen, 0, sizeof(seen));
+        for (c = m->clients; c; c = c->next) {
+            if (!c->tags)
+                continue;
+            rows |= c->tags & -c->tags;
+            count[__builtin_ctzll(c->tags)]++;
+        }
+        if (!(nrows = __builtin_popcountll(rows)))
+            continue;
+        rowh = (m->mh - PAD) / nrows;
+        for (c = m->clients; c; c = c->next) {
+            if (!c->tags)
+                continue;
+            i = __builtin_ctzll(c->tags);
+            cellw = (m->mw - PAD) / count[i];
+            t = &thumbs[nthumbs++];
+            t->win = c->win;
+            t->tag = TAGBIT(i);
+            t->x = m->mx + PAD + seen[i]++ * cellw;
+            t->y = m->my + PAD + __builtin_popcountll(rows & (t->tag - 1)) * rowh + gwm.bh;
+            t->w = MAX(cellw - PAD, 1);
+            t->h = MAX(rowh - gwm.bh - PAD, 1);
+            reuse(t, old, nold);
+        }
+    }
+    for (i = 0; i < (unsigned int)nold; i++)
+        freethumb(&old[i]);
+    free(old);
+}
+
+/* scale the window's current frame into the thumbnail, 0 if it is up to date */
+static int scalethumb(Thumb *t)
+{
+    XTransform xf = {{
+        { XDoubleToFixed(1), 0, 0 },
+        { 0, XDoubleToFixed(1), 0 },
+        { 0, 0, XDoubleToFixed(1) },
+    }};
+    unsigned int serial;
+    int fw, fh, tw, th;
+    Picture src;
+    double s;
+
+    if (!(src = compframe(t->win, &fw, &fh, &serial)) || fw <= 0 || fh <= 0)
+        return 0;
+    s = MAX(MAX((double)fw / t->w, (double)fh / t->h), 1.0);
+    tw = MAX(fw / s, 1);
+    th = MAX(fh / s, 1);
+    if (t->pict && t->serial == serial && t->tw == tw && t->th == th)
+        return 0;
+    if (!t->pict || t->tw != tw || t->th != th) {
+        freethumb(t);
+        t->pix = XCreatePixmap(gwm.dpy, gwm.root, tw, th, DefaultDepth(gwm.dpy, gwm.screen));
+        t->pict = XRenderCreatePicture(gwm.dpy, t->pix,
+            XRenderFindVisualFormat(gwm.dpy, DefaultVisual(gwm.dpy, gwm.screen)), 0, NULL);
+        t->tw = tw;
+        t->th = th;
+    }
+    /* the frame picture is shared with the compositor, leave it as found */
+    xf.matrix[0][0] = xf.matrix[1][1] = XDoubleToFixed(s);
+    XRenderSetPictureTransform(gwm.dpy, src, &xf);
+    XRenderSetPictureFilter(gwm.dpy, src, FilterBilinear, NULL, 0);
+    XRenderComposite(gwm.dpy, PictOpSrc, src, None, t->pict, 0, 0, 0, 0, 0, 0, tw, th);
+    xf.matrix[0][0] = xf.matrix[1][1] = XDoubleToFixed(1);
+    XRenderSetPictureTransform(gwm.dpy, src, &xf);
+    XRenderSetPictureFilter(gwm.dpy, src, FilterNearest, NULL, 0);
+    t->serial = serial;
+    return 1;
+}
+
+/* drawn with XRender only, the pixmap is copied to the window by show() */
+static void drawthumb(Thumb *t)
+{
+    Client *c = wintoclient(t->win);
+    int x = t->x + (t->w - t->tw) / 2;
+    int y = t->y + (t->h - t->th) / 2;
+
+    XRenderFillRectangle(gwm.dpy, PictOpSrc, ovpict, &gwm.scheme[SchemeNorm][ColBg].color, t->x, t->y, t->w, t->h);
+    if (!t->pict)
+        return;
+    /* focused clients get a frame in the focus colour */
+    if (c && c->devices)
+        XRenderFillRectangle(gwm.dpy, PictOpSrc, ovpict,
+            &gwm.scheme[CLAMP(SchemeNorm + c->devices, SchemeNorm, SchemeSel3)][ColBorder].color,
+            x - 2, y - 2, t->tw + 4, t->th + 4);
+    XRenderComposite(gwm.dpy, PictOpSrc, t->pict, None, ovpict, 0, 0, 0, 0, x, y, t->tw, t->th);
+}
+
+/* a header window above every row, drawn once it is exposed */
+static void makelabels(void)
+{
+    XSetWindowAttributes wa = { .event_mask = ExposureMask };
+    Tagset rows;
+    Monitor *m;
+    Client *c;
+    Label *l;
+    int y, rowh, n = 0;
+
+    for (m = gwm.mons; m; m = m->next)
+        for (c = m->clients; c; c = c->next)
+            n++;
+    labels = ecalloc(MAX(n, 1), sizeof(Label));
+    nlabels = 0;
+    for (m = gwm.mons; m; m = m->next) {
+        rows = 0;
+        for (c = m->clients; c; c = c->next)
+            rows |= c->tags & -c->tags;
+        if (!rows || m->mw <= 2 * PAD)
+            continue;
+        rowh = (m->mh - PAD) / __builtin_popcountll(rows);
+        for (y = m->my + PAD; rows; rows &= rows - 1, y += rowh) {
+            l = &labels[nlabels++];
+            l->tag = __builtin_ctzll(rows);
+            l->sel = !!(m->tagset[m->seltags] & TAGBIT(l->tag));
+            l->w = m->mw - 2 * PAD;
+            wa.background_pixel = gwm.scheme[l->sel ? SchemeSel : SchemeNorm][ColBg].pixel;
+            l->win = XCreateWindow(gwm.dpy, ovwin, m->mx + PAD, y, l->w, gwm.bh - gcfg.bhgappx, 0,
+                CopyFromParent, CopyFromParent, CopyFromParent, CWBackPixel|CWEventMask, &wa);
+        }
+    }
+    XMapSubwindows(gwm.dpy, ovwin);
+}
+
+/* copy part of the pixmap to the window, the tag names are clipped out */
+static void show(int x, int y, int w, int h)
+{
+    XRenderComposite(gwm.dpy, PictOpSrc, ovpict, None, ovwinpict, x, y, 0, 0, x, y, w, h);
+}
+
+static void drawall(void)
+{
+    unsigned int i;
+
+    XRenderFillRectangle(gwm.dpy, PictOpSrc, ovpict, &gwm.scheme[SchemeNorm][ColBg].color, 0, 0, gwm.sw, gwm.sh);
+    for (i = 0; i < (unsigned int)nthumbs; i++) {
+        scalethumb(&thumbs[i]);
+        drawthumb(&thumbs[i]);
+    }
+    show(0, 0, gwm.sw, gwm.sh);
+}
+
+static void closeoverview(void)
+{
+    unindexwin(ovwin);
+    XRenderFreePicture(gwm.dpy, ovwinpict);
+    XDestroyWindow(gwm.dpy, ovwin);
+    XRenderFreePicture(gwm.dpy, ovpict);
+    XFreePixmap(gwm.dpy, ovpix);
+    ovwin = None;
+    free(labels);
+    labels = NULL;
+    nlabels = 0;
+}
+
+/* view the client's tag on its monitor and focus it, one arrange */
+static void jump(DevPair *dp, Client *c, Tagset tag)
+{
+    Monitor *m = c->mon;
+
+    if (m != dp->selmon) {
+        unfocus(dp, 1);
+        setselmon(dp, m);
+    }
+    if (!ISVISIBLE(c)) {
+        m->seltags ^= 1;
+        m->tagset[m->seltags] = tag;
+    }
+    focus(dp, c);
+    arrange(m);
+}
+
+void toggleoverview(__attribute__((unused)) DevPair *dp, __attribute__((unused)) const Arg *arg)
+{
+    XSetWindowAttributes wa = {
+        .override_redirect = True,
+        .background_pixmap = None,
+    };
+
+    if (ovwin) {
+        closeoverview();
+        return;
+    }
+    if (!compactive())
+        return;
+    layout();
+    ovpix = XCreatePixmap(gwm.dpy, gwm.root, gwm.sw, gwm.sh, DefaultDepth(gwm.dpy, gwm.screen));
+    ovpict = XRenderCreatePicture(gwm.dpy, ovpix,
+        XRenderFindVisualFormat(gwm.dpy, DefaultVisual(gwm.dpy, gwm.screen)), 0, NULL);
+    ovwin = XCreateWindow(gwm.dpy, gwm.root, 0, 0, gwm.sw, gwm.sh, 0, DefaultDepth(gwm.dpy, gwm.screen),
+        CopyFromParent, DefaultVisual(gwm.dpy, gwm.screen), CWOverrideRedirect|CWBackPixmap, &wa);
+    ovwinpict = XRenderCreatePicture(gwm.dpy, ovwin,
+        XRenderFindVisualFormat(gwm.dpy, DefaultVisual(gwm.dpy, gwm.screen)), 0, NULL);
+    XDefineCursor(gwm.dpy, ovwin, gwm.cursor[CurNormal]->cursor);
+    XISelectEvents(gwm.dpy, ovwin, &ptrevm, 1);
+    indexwin(ovwin, WinHelper, NULL);
+    makelabels();
+    XMapRaised(gwm.dpy, ovwin);
+    drawall();
+}
+
+/* returns 1 if w is one of the tag names, which is then drawn again */
+int overviewexpose(Window w)
+{
+    int i;
+
+    for (i = 0; i < nlabels; i++)
+        if (labels[i].win == w) {
+            barlabel(w, labels[i].w, gwm.bh - gcfg.bhgappx,
+                gwm.scheme[labels[i].sel ? SchemeSel : SchemeNorm], gtags[labels[i].tag]);
+            return 1;
+        }
+    return 0;
+}
+
+/* rescale the thumbnails of windows that were damaged since the last batch */
+void overviewflush(void)
+{
+    int i;
+
+    if (!ovwin)
+        return;
+    for (i = 0; i < nthumbs; i++)
+        if (scalethumb(&thumbs[i])) {
+            drawthumb(&thumbs[i]);
+            show(thumbs[i].x - 2, thumbs[i].y - 2, thumbs[i].w + 4, thumbs[i].h + 4);
+        }
+}
+
+/* returns 1 if the press was on the overview */
+int overviewclick(DevPair *dp, XIDeviceEvent *e)
+{
+    Client *c = NULL;
+    Tagset tag = 0;
+    int i, x = e->event_x, y = e->event_y;
+
+    if (!ovwin || e->event != ovwin)
+        return 0;
+    for (i = 0; i < nthumbs; i++)
+        if (BETWEEN(x, thumbs[i].x, thumbs[i].x + thumbs[i].w - 1)
+        && BETWEEN(y, thumbs[i].y, thumbs[i].y + thumbs[i].h - 1)) {
+            c = wintoclient(thumbs[i].win);
+            tag = thumbs[i].tag;
+            break;
+        }
+    closeoverview();
+    if (c)
+        jump(dp, c, tag);
+    return 1;
+}
+
+void overviewcleanup(void)
+{
+    int i;
+
+    if (ovwin)
+        closeoverview();
+    for (i = 0; i < nthumbs; i++)
+        freethumb(&thumbs[i]);
+    free(thumbs);
+    thumbs = NULL;
+    nthumbs = 0;
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include "common.h"
+
+extern void toggleoverview(DevPair *dp, const Arg *arg);
+extern void overviewflush(void);
+extern int overviewexpose(Window w);
+extern int overviewclick(DevPair *dp, XIDeviceEvent *e);
+extern void overviewcleanup(void);
@@ -0,0 +1,239 @@
+#include "resizesync.h"
+#include "client.h"
+#include "util.h"
+
+#include <X11/extensions/sync.h>
+#include <stdio.h>
+#include <time.h>
+
+/*
+ * _NET_WM_SYNC_REQUEST support for interactive resizes. Before a new size is
+ * sent the client is asked to bump its sync counter once it has redrawn, an
+ * alarm on that counter tells us when it did. Sizes produced by the pointer
+ * while the client is still busy only replace the pending size, so a slow
+ * client gets the latest size instead of a backlog of stale ones. A client
+ * that does not answer within SYNC_TIMEOUT ms is sent the next size anyway,
+ * syncflush() gives run() the deadline so that happens without more motion.
+ */
+
+#define SYNC_TIMEOUT 100 /* ms */
+
+static Client *syncing; /* client of the interactive resize */
+
+static long nowms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int64_t syncvalue(XSyncValue v)
+{
+    return ((int64_t)XSyncValueHigh32(v) << 32) | XSyncValueLow32(v);
+}
+
+static Client *alarmtoclient(XSyncAlarm alarm)
+{
+    Monitor *m;
+    Client *c;
+
+    for (m = gwm.mons; m; m = m->next)
+        for (c = m->clients; c; c = c->next)
+            if (c->sync.alarm == alarm)
+                return c;
+    return NULL;
+}
+
+static int hassyncprotocol(Client *c)
+{
+    Atom *protocols;
+    int n, exists = 0;
+
+    if (XGetWMProtocols(gwm.dpy, c->win, &protocols, &n)) {
+        while (!exists && n--)
+            exists = protocols[n] == gwm.netatom[NetWMSyncRequest];
+        XFree(protocols);
+    }
+    return exists;
+}
+
+static XSyncCounter getsynccounter(Client *c)
+{
+    int format;
+    unsigned long nitems, remaining;
+    unsigned char *p = NULL;
+    Atom type;
+    XSyncCounter counter = None;
+
+    if (XGetWindowProperty(gwm.dpy, c->win, gwm.netatom[NetWMSyncRequestCounter], 0L, 1L, False,
+        XA_CARDINAL, &type, &format, &nitems, &remaining, &p) == Success && p) {
+        if (nitems && format == 32)
+            counter = *(long *)p;
+        XFree(p);
+    }
+    return counter;
+}
+
+static void sendsyncrequest(Client *c, Time time)
+{
+    XSyncAlarmAttributes attr;
+    XEvent ev;
+
+    c->sync.value++;
+
+    XSyncIntsToValue(&attr.trigger.wait_value, c->sync.value & 0xffffffff, c->sync.value >> 32);
+    XSyncChangeAlarm(gwm.dpy, c->sync.alarm, XSyncCAValue, &attr);
+
+    ev.type = ClientMessage;
+    ev.xclient.window = c->win;
+    ev.xclient.message_type = gwm.wmatom[WMProtocols];
+    ev.xclient.format = 32;
+    ev.xclient.data.l[0] = gwm.netatom[NetWMSyncRequest];
+    ev.xclient.data.l[1] = time;
+    ev.xclient.data.l[2] = c->sync.value & 0xffffffff;
+    ev.xclient.data.l[3] = c->sync.value >> 32;
+    ev.xclient.data.l[4] = 0;
+    XSendEvent(gwm.dpy, c->win, False, NoEventMask, &ev);
+
+    c->sync.waiting = 1;
+    c->sync.sent = time;
+    c->sync.sentms = nowms();
+    c->sync.nsent++;
+}
+
+void syncinit(void)
+{
+    int major, minor;
+
+    gwm.syncevent = -1;
+    if (!XQueryExtension(gwm.dpy, "SYNC", &gwm.syncopcode, &gwm.syncevent, &(int){0})
+    || !XSyncInitialize(gwm.dpy, &major, &minor)) {
+        DBG("syncinit: SYNC extension not available\n");
+        gwm.syncevent = -1;
+    }
+}
+
+/* called when an interactive resize starts */
+void syncbegin(Client *c)
+{
+    XSyncAlarmAttributes attr;
+    XSyncCounter counter;
+    XSyncValue v;
+
+    c->sync.waiting = c->sync.pending = 0;
+    c->sync.nsent = c->sync.ndropped = c->sync.ntimeout = 0;
+
+    if (gwm.syncevent < 0 || !hassyncprotocol(c) || !(counter = getsynccounter(c))) {
+        syncfree(c);
+        return;
+    }
+    if (c->sync.alarm && c->sync.counter == counter) {
+        syncing = c;
+        return;
+    }
+
+    syncfree(c);
+    if (!XSyncQueryCounter(gwm.dpy, counter, &v))
+        return;
+
+    c->sync.counter = counter;
+    c->sync.value = syncvalue(v);
+    attr.trigger.counter = counter;
+    attr.trigger.value_type = XSyncAbsolute;
+    attr.trigger.test_type = XSyncPositiveComparison;
+    XSyncIntsToValue(&attr.trigger.wait_value, c->sync.value & 0xffffffff, c->sync.value >> 32);
+    XSyncIntToValue(&attr.delta, 0);
+    attr.events = True;
+    c->sync.alarm = XSyncCreateAlarm(gwm.dpy,
+        XSyncCACounter | XSyncCAValueType | XSyncCAValue | XSyncCATestType | XSyncCADelta | XSyncCAEvents,
+        &attr);
+    syncing = c;
+}
+
+/* resize() for interactive resizes, paced by the client's sync counter */
+void syncresize(Client *c, int x, int y, int w, int h, Time time)
+{
+    int ow = c->w, oh = c->h;
+
+    if (c->sync.alarm && c->sync.waiting) {
+        if (nowms() - c->sync.sentms < SYNC_TIMEOUT) {
+            c->sync.ndropped += c->sync.pending;
+            c->sync.pending = 1;
+            c->sync.x = x;
+            c->sync.y = y;
+            c->sync.w = w;
+            c->sync.h = h;
+            return;
+        }
+        c->sync.ntimeout++;
+        c->sync.waiting = 0;
+    }
+
+    c->sync.pending = 0;
+    resize(c, x, y, w, h, 1);
+    /* the counter is only bumped after a configure, so only ask when the size changed */
+    if (c->sync.alarm && (c->w != ow || c->h != oh))
+        sendsyncrequest(c, time);
+}
+
+/* called when an interactive resize ends, apply is False when it was cancelled */
+void syncend(Client *c, int apply)
+{
+    if (apply && c->sync.pending)
+        resize(c, c->sync.x, c->sync.y, c->sync.w, c->sync.h, 1);
+    c->sync.pending = 0;
+    c->sync.waiting = 0;
+    if (syncing == c)
+        syncing = NULL;
+    /* how smooth the resize was, dropped sizes were replaced by newer ones */
+    if (c->sync.alarm && c->sync.nsent) {
+        DBG("syncend 0x%lx: sent %u, dropped %u (%u%%), timeouts %u\n", c->win,
+            c->sync.nsent, c->sync.ndropped, c->sync.ndropped * 100 / (c->sync.nsent + c->sync.ndropped),
+            c->sync.ntimeout);
+    }
+}
+
+void syncfree(Client *c)
+{
+    if (c->sync.alarm)
+        XSyncDestroyAlarm(gwm.dpy, c->sync.alarm);
+    c->sync.alarm = None;
+    c->sync.counter = None;
+    c->sync.waiting = c->sync.pending = 0;
+    if (syncing == c)
+        syncing = NULL;
+}
+
+void syncalarmnotify(XEvent *e)
+{
+    XSyncAlarmNotifyEvent *ev = (XSyncAlarmNotifyEvent *)e;
+    Client *c;
+
+    if (!(c = alarmtoclient(ev->alarm)) || !c->sync.waiting)
+        return;
+    if (syncvalue(ev->counter_value) < c->sync.value)
+        return;
+
+    c->sync.waiting = 0;
+    if (c->sync.pending)
+        syncresize(c, c->sync.x, c->sync.y, c->sync.w, c->sync.h, ev->time);
+}
+
+/*
+ * send the pending size of a client that did not answer in time, called
+ * before commit() once the queue is drained. Returns the milliseconds until
+ * the current request times out or -1 if nothing is pending.
+ */
+int syncflush(void)
+{
+    Client *c = syncing;
+    long elapsed;
+
+    if (!c || !c->sync.waiting || !c->sync.pending)
+        return -1;
+    if ((elapsed = nowms() - c->sync.sentms) < SYNC_TIMEOUT)
+        return SYNC_TIMEOUT - elapsed;
+    syncresize(c, c->sync.x, c->sync.y, c->sync.w, c->sync.h, c->sync.sent + elapsed);
+    return -1;
+}
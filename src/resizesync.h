@@ -0,0 +1,11 @@
+#pragma once
+
+#include "common.h"
+
+extern void syncinit(void);
+extern void syncbegin(Client *c);
+extern void syncresize(Client *c, int x, int y, int w, int h, Time time);
+extern void syncend(Client *c, int apply);
+extern void syncfree(Client *c);
+extern void syncalarmnotify(XEvent *e);
+extern int syncflush(void);
@@ -1,92 +1,307 @@
 #include "resolvers.h"
 #include "devpair.h"
+#include "util.h"
 
-Monitor *dirtomon(DevPair *dp, int dir)
+#include <stdlib.h>
+
+/*
+ * Index from XID to what mpwm made of the window, so resolving an event's
+ * window does not depend on the number of clients. Open addressing with
+ * linear probing, at most half full. Removing an entry moves the ones after
+ * it back instead of leaving tombstones. None marks an empty slot.
+ */
+typedef struct {
+    Window win;
+    int kind;
+    void *p;              /* Client for WinClient and WinPopup, Monitor for WinBar */
+} WinEntry;
+
+static WinEntry *table;
+static unsigned int tablecap; /* power of two */
+static unsigned int tableused;
+
+static unsigned int winslot(Window w)
+{
+    return (unsigned int)(((uint64_t)w * 0x9e3779b97f4a7c15ULL) >> 32) & (tablecap - 1);
+}
+
+static WinEntry *lookup(Window w)
+{
+    unsigned int i;
+
+    if (!tableused || w == None)
+        return NULL;
+    for (i = winslot(w); table[i].win; i = (i + 1) & (tablecap - 1))
+        if (table[i].win == w)
+            return &table[i];
+    return NULL;
+}
+
+static void grow(void)
 {
-    int best_neg = 0;
-    int best_pos = 0;
-    int middle = dp->selmon->mx + (dp->selmon->mw / 2);
-    int delta;
-    Monitor *m = NULL;
-    Monitor *m_left = NULL;
-    Monitor *m_right = NULL;
-
-    // Left
-    if (dir > 0)
-    {
-        // looking for the closest positive number
-        for(m = gwm.mons; m; m = m->next)
-        {
-            if(m == dp->selmon)
-                continue;
-            delta = middle - (m->mx + (m->mw / 2));
-            // look for closest left screen (closest to 0 positive number)
-            if((!best_pos && delta > 0) || (best_pos && delta > 0 && best_pos > delta))
-            {
-                best_pos = delta;
-                m_left = m;
-            }
-            // look for furthest right screen (furthest away from 0 negative number)
-            if((!best_neg && delta < 0) || (best_neg && delta < 0 && best_neg > delta))
-            {
-                best_neg = delta;
-                m_right = m;
-            }
+    WinEntry *old = table;
+    unsigned int i, j, oldcap = tablecap;
+
+    tablecap = tablecap ? tablecap * 2 : 64;
+    table = ecalloc(tablecap, sizeof(WinEntry));
+    for (i = 0; i < oldcap; i++) {
+        if (!old[i].win)
+            continue;
+        for (j = winslot(old[i].win); table[j].win; j = (j + 1) & (tablecap - 1));
+        table[j] = old[i];
+    }
+    free(old);
+}
+
+/* add w or change what it is */
+void indexwin(Window w, int kind, void *p)
+{
+    WinEntry *e;
+    unsigned int i;
+
+    if (w == None)
+        return;
+    if (!(e = lookup(w))) {
+        if (2 * (tableused + 1) > tablecap)
+            grow();
+        for (i = winslot(w); table[i].win; i = (i + 1) & (tablecap - 1));
+        e = &table[i];
+        e->win = w;
+        tableused++;
+    }
+    e->kind = kind;
+    e->p = p;
+}
+
+void unindexwin(Window w)
+{
+    WinEntry *e;
+    unsigned int i, j, home;
+
+    if (!(e = lookup(w)))
+        return;
+    i = e - table;
+    /* move back every entry of the run that would not be found past the hole */
+    for (j = (i + 1) & (tablecap - 1); table[j].win; j = (j + 1) & (tablecap - 1)) {
+        home = winslot(table[j].win);
+        if (((j - home) & (tablecap - 1)) >= ((j - i) & (tablecap - 1))) {
+            table[i] = table[j];
+            i = j;
         }
-        return m_left ? m_left : m_right;
     }
+    table[i].win = None;
+    tableused--;
+}
+
+void freewinindex(void)
+{
+    free(table);
+    table = NULL;
+    tablecap = tableused = 0;
+}
+
+/* WinClient, WinPopup, WinBar, WinHelper or 0 for windows mpwm does not know */
+int winkind(Window w)
+{
+    WinEntry *e = lookup(w);
 
-    // Right
-    // looking for the closest positive number
-    for(m = gwm.mons; m; m = m->next)
-    {
-        if(m == dp->selmon)
+    return e ? e->kind : 0;
+}
+
+/*
+ * Monitor topology, rebuilt on the first lookup after topologychanged().
+ * Points are resolved through a grid made of the sorted monitor edges, each
+ * cell holding the monitor recttomon() would pick for it, the cell of the
+ * last hit is checked first. Every monitor keeps its neighbour in each
+ * direction in adj[].
+ */
+enum { AdjLeft, AdjRight, AdjUp, AdjDown };
+
+static int topodirty = 1;
+static int *xs, *ys;        /* sorted unique cell edges */
+static int nxs, nys;
+static Monitor **cells;     /* (nxs - 1) * (nys - 1), row by row */
+static int lastcx = -1, lastcy = -1;
+
+void topologychanged(void)
+{
+    topodirty = 1;
+}
+
+static int cmpint(const void *a, const void *b)
+{
+    return (*(const int *)a > *(const int *)b) - (*(const int *)a < *(const int *)b);
+}
+
+static int uniqueints(int *v, int n)
+{
+    int i, j;
+
+    qsort(v, n, sizeof(int), cmpint);
+    for (i = j = 0; i < n; i++)
+        if (!j || v[j - 1] != v[i])
+            v[j++] = v[i];
+    return j;
+}
+
+/* index of the cell edge at or left of v, -1 outside of the edges */
+static int findedge(const int *v, int n, int x)
+{
+    int lo = 0, hi = n, mid;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (v[mid] <= x)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo > 0 && lo < n ? lo - 1 : -1;
+}
+
+static int overlaps(Monitor *a, Monitor *b, int vertical)
+{
+    return vertical
+        ? a->mx < b->mx + b->mw && b->mx < a->mx + a->mw
+        : a->my < b->my + b->mh && b->my < a->my + a->mh;
+}
+
+/*
+ * closest monitor in the direction by centre distance, wrapping around to
+ * the furthest one the other way. dir > 0 looks left (up), dir < 0 right
+ * (down). With aligned set only monitors sharing a row (column) count.
+ */
+static Monitor *scanneighbour(Monitor *sel, int vertical, int dir, int aligned)
+{
+    int mid = vertical ? sel->my + sel->mh / 2 : sel->mx + sel->mw / 2;
+    int delta, near = 0, far = 0;
+    Monitor *m, *mnear = NULL, *mfar = NULL;
+
+    for (m = gwm.mons; m; m = m->next) {
+        if (m == sel || (aligned && !overlaps(sel, m, vertical)))
             continue;
-        delta = middle - (m->mx + (m->mw / 2));
-        // look for the left screen (closest to 0 negative number)
-        if((!best_neg && delta < 0) || (best_neg && delta < 0 && best_neg < delta))
-        {
-            best_neg = delta;
-            m_right = m;
+        delta = mid - (vertical ? m->my + m->mh / 2 : m->mx + m->mw / 2);
+        if (dir < 0)
+            delta = -delta;
+        if (delta > 0 && (!mnear || delta < near)) {
+            near = delta;
+            mnear = m;
         }
-        // look for the right screen (furthest away from 0 positive number)
-        if((!best_pos && delta > 0) || (best_pos && delta > 0 && best_pos < delta))
-        {
-            best_pos = delta;
-            m_left = m;
+        if (delta < 0 && (!mfar || delta < far)) {
+            far = delta;
+            mfar = m;
         }
     }
-    return m_right ? m_right : m_left;
+    return mnear ? mnear : mfar;
 }
 
-Monitor *anywintomon(Window w)
+static Monitor *neighbour(Monitor *sel, int vertical, int dir)
 {
-    Client *c;
     Monitor *m;
 
+    return (m = scanneighbour(sel, vertical, dir, 1)) ? m : scanneighbour(sel, vertical, dir, 0);
+}
+
+static void updatetopology(void)
+{
+    Monitor *m;
+    int n, i, j, x, y;
+
+    if (!topodirty)
+        return;
+    for (n = 0, m = gwm.mons; m; m = m->next)
+        n++;
+    free(xs);
+    free(ys);
+    free(cells);
+    xs = ecalloc(MAX(2 * n, 1), sizeof(int));
+    ys = ecalloc(MAX(2 * n, 1), sizeof(int));
+    /* the same area INTERSECT() measures, bar included */
+    for (i = 0, m = gwm.mons; m; m = m->next, i += 2) {
+        xs[i] = m->wx;
+        xs[i + 1] = m->wx + m->ww;
+        ys[i] = m->wy - (m->showbar && m->topbar ? gwm.bh : 0);
+        ys[i + 1] = m->wy + m->wh + (m->showbar && !m->topbar ? gwm.bh : 0);
+    }
+    nxs = uniqueints(xs, 2 * n);
+    nys = uniqueints(ys, 2 * n);
+    cells = ecalloc(MAX((nxs - 1) * (nys - 1), 1), sizeof(Monitor *));
+    for (j = 0; j < nys - 1; j++)
+        for (i = 0; i < nxs - 1; i++) {
+            x = xs[i];
+            y = ys[j];
+            /* first monitor in list order, as recttomon() picks it */
+            for (m = gwm.mons; m && INTERSECT(x, y, 1, 1, m) <= 0; m = m->next);
+            cells[j * (nxs - 1) + i] = m;
+        }
     for (m = gwm.mons; m; m = m->next) {
-        if(m->barwin == w)
-            return m;
-        for (c = m->clients; c; c = c->next)
-            if (c->win == w)
-                return c->mon;
+        m->adj[AdjLeft] = neighbour(m, 0, 1);
+        m->adj[AdjRight] = neighbour(m, 0, -1);
+        m->adj[AdjUp] = neighbour(m, 1, 1);
+        m->adj[AdjDown] = neighbour(m, 1, -1);
     }
+    lastcx = lastcy = -1;
+    topodirty = 0;
+}
+
+/* monitor under the point, NULL if it is on none */
+static Monitor *pointtomon(int x, int y)
+{
+    updatetopology();
+    if (lastcx < 0 || x < xs[lastcx] || x >= xs[lastcx + 1]
+    || y < ys[lastcy] || y >= ys[lastcy + 1]) {
+        if ((lastcx = findedge(xs, nxs, x)) < 0 || (lastcy = findedge(ys, nys, y)) < 0) {
+            lastcx = -1;
+            return NULL;
+        }
+    }
+    return cells[lastcy * (nxs - 1) + lastcx];
+}
+
+/*
+ * dir > 0 is the monitor to the left, dir < 0 the one to the right, 2 and -2
+ * up and down. dp->selmon itself if there is none in that direction.
+ */
+Monitor *dirtomon(DevPair *dp, int dir)
+{
+    Monitor *m;
+
+    updatetopology();
+    if (dir == 2 || dir == -2)
+        m = dp->selmon->adj[dir > 0 ? AdjUp : AdjDown];
+    else
+        m = dp->selmon->adj[dir > 0 ? AdjLeft : AdjRight];
+    return m ? m : dp->selmon;
+}
+
+Monitor *anywintomon(Window w)
+{
+    WinEntry *e = lookup(w);
+
+    if (e && e->kind == WinBar)
+        return e->p;
+    if (e && e->kind == WinClient)
+        return ((Client *)e->p)->mon;
     return NULL;
 }
 
+/* monitor whose bar is w */
+Monitor *wintobar(Window w)
+{
+    WinEntry *e = lookup(w);
+
+    return e && e->kind == WinBar ? e->p : NULL;
+}
+
 Monitor *wintomon(DevPair *dp, Window w)
 {
     int x, y;
-    Client *c;
     Monitor *m;
 
     if (w == gwm.root && getrootptr(dp, &x, &y))
         return recttomon(dp, x, y, 1, 1);
-    for (m = gwm.mons; m; m = m->next)
-        if (w == m->barwin)
-            return m;
-    if ((c = wintoclient(w)))
-        return c->mon;
+    if ((m = anywintomon(w)))
+        return m;
     return dp->selmon;
 }
 
@@ -95,6 +310,8 @@ Monitor *recttomon(DevPair *dp, int x, int y, int w, int h)
     Monitor *m, *r = dp->selmon;
     int a, area = 0;
 
+    if (w == 1 && h == 1)
+        return (m = pointtomon(x, y)) ? m : r;
     for (m = gwm.mons; m; m = m->next)
         if ((a = INTERSECT(x, y, w, h, m)) > area) {
             area = a;
@@ -103,16 +320,17 @@ Monitor *recttomon(DevPair *dp, int x, int y, int w, int h)
     return r;
 }
 
+/* clients in a monitor's client list, see attach() and detach() */
 Client *wintoclient(Window w)
 {
-    Client *c;
-    Monitor *m;
+    WinEntry *e = lookup(w);
 
-    for (m = gwm.mons; m; m = m->next) {
-        for (c = m->clients; c; c = c->next) {
-            if (c->win == w)
-                return c;
-        }
-    }
-    return NULL;
+    return e && e->kind == WinClient ? e->p : NULL;
+}
+
+Client *wintopopup(Window w)
+{
+    WinEntry *e = lookup(w);
+
+    return e && e->kind == WinPopup ? e->p : NULL;
 }
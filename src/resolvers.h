@@ -2,8 +2,24 @@
 
 #include "common.h"
 
+/* what a window is to mpwm, see indexwin() */
+enum {
+    WinClient = 1,
+    WinPopup,
+    WinBar,
+    WinHelper,            /* windows of mpwm's own that are never managed */
+};
+
+extern void indexwin(Window w, int kind, void *p);
+extern void unindexwin(Window w);
+extern void freewinindex(void);
+extern int winkind(Window w);
+
+extern void topologychanged(void);
 extern Monitor *dirtomon(DevPair *dp, int dir);
 extern Monitor *anywintomon(Window w);
+extern Monitor *wintobar(Window w);
 extern Monitor *wintomon(DevPair *dp, Window w);
 extern Monitor *recttomon(DevPair *dp, int x, int y, int w, int h);
-extern Client *wintoclient(Window w);
\ No newline at end of file
+extern Client *wintoclient(Window w);
+extern Client *wintopopup(Window w);
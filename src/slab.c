@@ -0,0 +1,102 @@
+#include "slab.h"
+#include "util.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Objects are carved out of slabs of SLABOBJS objects each. Objects that
+ * are allocated together sit next to each other, which keeps walks over
+ * the client lists on few cache lines. Objects of 64 bytes and more start
+ * on a cache line of their own. Freed objects go onto the pool's free list,
+ * slabs are only returned by slabdestroy().
+ *
+ * Strings (client titles) are kept in pools of their own, one per power of
+ * two from 16 to 2048 bytes. The byte before a string names its pool.
+ */
+
+#define CACHELINE 64
+#define SLABOBJS  64
+
+struct Slab {
+    Slab *next;
+};
+
+static SlabPool strpools[] = {
+    { .size = 16 }, { .size = 32 }, { .size = 64 }, { .size = 128 },
+    { .size = 256 }, { .size = 512 }, { .size = 1024 }, { .size = 2048 },
+};
+
+static size_t objsize(const SlabPool *p)
+{
+    size_t align = p->size >= CACHELINE ? CACHELINE : sizeof(void *);
+
+    return (MAX(p->size, sizeof(void *)) + align - 1) / align * align;
+}
+
+/* zeroed object from p */
+void *slaballoc(SlabPool *p)
+{
+    size_t sz = objsize(p);
+    unsigned int i;
+    char *o;
+    Slab *s;
+
+    if (!p->free) {
+        /* the header takes a whole line so the objects stay aligned */
+        if (!(s = aligned_alloc(CACHELINE, CACHELINE + SLABOBJS * sz)))
+            die("slaballoc:");
+        s->next = p->slabs;
+        p->slabs = s;
+        for (i = SLABOBJS; i-- > 0;) {
+            o = (char *)s + CACHELINE + i * sz;
+            *(void **)o = p->free;
+            p->free = o;
+        }
+    }
+    o = p->free;
+    p->free = *(void **)o;
+    memset(o, 0, sz);
+    return o;
+}
+
+void slabfree(SlabPool *p, void *obj)
+{
+    if (!obj)
+        return;
+    *(void **)obj = p->free;
+    p->free = obj;
+}
+
+/* frees every object of p at once */
+void slabdestroy(SlabPool *p)
+{
+    Slab *s;
+
+    while ((s = p->slabs)) {
+        p->slabs = s->next;
+        free(s);
+    }
+    p->free = NULL;
+}
+
+/* copy of s, truncated if it does not fit the largest pool */
+char *strstore(const char *s)
+{
+    size_t n = strlen(s) + 2; /* pool index and terminator */
+    unsigned int i;
+    char *p;
+
+    for (i = 0; i < sizeof(strpools) / sizeof(strpools[0]) - 1 && strpools[i].size < n; i++);
+    n = MIN(n, strpools[i].size);
+    p = slaballoc(&strpools[i]);
+    p[0] = i;
+    memcpy(p + 1, s, n - 2);
+    return p + 1;
+}
+
+void strdrop(char *s)
+{
+    if (s)
+        slabfree(&strpools[(unsigned char)s[-1]], s - 1);
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stddef.h>
+
+typedef struct Slab Slab;
+
+/* pool of same sized objects, see slab.c */
+typedef struct {
+    size_t size;          /* object size as asked for */
+    void *free;           /* free objects, linked through their first word */
+    Slab *slabs;
+} SlabPool;
+
+#define SLABPOOL(type) { .size = sizeof(type) }
+
+extern void *slaballoc(SlabPool *p);
+extern void slabfree(SlabPool *p, void *obj);
+extern void slabdestroy(SlabPool *p);
+
+extern char *strstore(const char *s);
+extern void strdrop(char *s);
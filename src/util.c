@@ -40,6 +40,15 @@ void die(const char *fmt, ...) {
     exit(1);
 }
 
+uint64_t hashbytes(uint64_t hash, const void *p, size_t n)
+{
+    const unsigned char *s = p;
+
+    while (n--)
+        hash = (hash ^ *s++) * 0x100000001b3ULL;
+    return hash;
+}
+
 char* read_file_to_buffer(const char *filename, size_t *size)
 {
     FILE *file = fopen(filename, "rb");  // Open file in binary mode
@@ -16,10 +16,48 @@ extern int log_fd;
 #define DBG(...) while(0) {}
 #endif
 
+/*
+ * intrusive doubly-linked lists with head and tail pointers, next and prev
+ * name the link fields so an object can sit in several lists
+ */
+#define LISTPUSH(head, tail, e, next, prev) do { \
+    (e)->prev = NULL; \
+    (e)->next = (head); \
+    if (head) \
+        (head)->prev = (e); \
+    else \
+        (tail) = (e); \
+    (head) = (e); \
+} while (0)
+#define LISTAPPEND(head, tail, e, next, prev) do { \
+    (e)->next = NULL; \
+    (e)->prev = (tail); \
+    if (tail) \
+        (tail)->next = (e); \
+    else \
+        (head) = (e); \
+    (tail) = (e); \
+} while (0)
+#define LISTREMOVE(head, tail, e, next, prev) do { \
+    if ((e)->next) \
+        (e)->next->prev = (e)->prev; \
+    else \
+        (tail) = (e)->prev; \
+    if ((e)->prev) \
+        (e)->prev->next = (e)->next; \
+    else \
+        (head) = (e)->next; \
+    (e)->next = (e)->prev = NULL; \
+} while (0)
+
 extern void *ecalloc(size_t nmemb, size_t size);
 extern void die(const char *fmt, ...);
 extern char* read_file_to_buffer(const char *filename, size_t *size);
 
+/* 64-bit FNV-1a, chain calls starting from HASH_INIT */
+#define HASH_INIT 0xcbf29ce484222325ULL
+extern uint64_t hashbytes(uint64_t hash, const void *p, size_t n);
+
 extern void swap_int(int *a, int *b);
 extern void swap_uint32(uint32_t *a, uint32_t *b);
 extern void swap_void(void **a, void **b);
@@ -0,0 +1,203 @@
+#include "xstate.h"
+#include "util.h"
+#include "client.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Handlers only change Client/Monitor state and mark it dirty, the X server
+ * is brought in line by commit(). Every client remembers what was last sent
+ * to the server (c->xs), so commit() only issues requests for values that
+ * actually differ: one XConfigureWindow with the changed fields, the border
+ * pixel, WM_STATE, _NET_WM_STATE and a single XRestackWindows for the whole
+ * stacking order.
+ *
+ * The stacking order is (top to bottom):
+ *   floating clients (by stackseq), floating_stack_helper, bars, tiled clients (by stackseq)
+ */
+
+void markdirty(Client *c)
+{
+    c->dirty = 1;
+    gwm.dirty = 1;
+}
+
+void markalldirty(void)
+{
+    Monitor *m;
+    Client *c;
+
+    for (m = gwm.mons; m; m = m->next)
+        for (c = m->clients; c; c = c->next)
+            markdirty(c);
+}
+
+void raiseclient(Client *c)
+{
+    c->stackseq = ++gwm.stacktop;
+    gwm.stackdirty = 1;
+}
+
+void lowerclient(Client *c)
+{
+    c->stackseq = --gwm.stackbottom;
+    gwm.stackdirty = 1;
+}
+
+/* what the server knows about a window we are about to manage */
+void initxstate(Client *c, XWindowAttributes *wa)
+{
+    c->xs.x = wa->x;
+    c->xs.y = wa->y;
+    c->xs.w = wa->width;
+    c->xs.h = wa->height;
+    c->xs.bw = wa->border_width;
+    c->xs.border = ~0UL; /* unknown */
+    c->xs.state = -1;
+    c->xs.fullscreen = 0;
+    markdirty(c);
+}
+
+static unsigned long borderpixel(Client *c)
+{
+    Clr **cur_scheme = gwm.forcedfocusmon ? gwm.ff_scheme : gwm.scheme;
+
+    return cur_scheme[CLAMP(SchemeNorm + c->devices, SchemeNorm, SchemeSel3)][ColBorder].pixel;
+}
+
+void commitclient(Client *c)
+{
+    XWindowChanges wc;
+    unsigned int mask = 0;
+    unsigned long border;
+    int x;
+
+    c->dirty = 0;
+
+    /* hidden clients are moved out of sight instead of being unmapped */
+    x = ISVISIBLE(c) ? c->x : WIDTH(c) * -2;
+    if (c->xs.x != x) {
+        c->xs.x = wc.x = x;
+        mask |= CWX;
+    }
+    if (c->xs.y != c->y) {
+        c->xs.y = wc.y = c->y;
+        mask |= CWY;
+    }
+    if (c->xs.w != c->w) {
+        c->xs.w = wc.width = c->w;
+        mask |= CWWidth;
+    }
+    if (c->xs.h != c->h) {
+        c->xs.h = wc.height = c->h;
+        mask |= CWHeight;
+    }
+    if (c->xs.bw != c->bw) {
+        c->xs.bw = wc.border_width = c->bw;
+        mask |= CWBorderWidth;
+    }
+    if (mask) {
+        XConfigureWindow(gwm.dpy, c->win, mask, &wc);
+        if (ISVISIBLE(c))
+            configure(c);
+    }
+
+    if (c->bw && c->xs.border != (border = borderpixel(c))) {
+        c->xs.border = border;
+        XSetWindowBorder(gwm.dpy, c->win, border);
+    }
+
+    if (c->xs.state != c->state) {
+        long data[] = { c->state, None };
+        c->xs.state = c->state;
+        XChangeProperty(gwm.dpy, c->win, gwm.wmatom[WMState], gwm.wmatom[WMState], 32, PropModeReplace, (unsigned char *)data, 2);
+    }
+
+    if (c->xs.fullscreen != c->isfullscreen) {
+        c->xs.fullscreen = c->isfullscreen;
+        XChangeProperty(gwm.dpy, c->win, gwm.netatom[NetWMState], XA_ATOM, 32, PropModeReplace,
+            (unsigned char *)&gwm.netatom[NetWMFullscreen], c->isfullscreen);
+    }
+}
+
+static int cmpstackseq(const void *a, const void *b)
+{
+    const Client *ca = *(Client *const *)a;
+    const Client *cb = *(Client *const *)b;
+
+    return (cb->stackseq > ca->stackseq) - (cb->stackseq < ca->stackseq);
+}
+
+static int collectlayer(Client **buf, int floating)
+{
+    Monitor *m;
+    Client *c;
+    int n = 0;
+
+    for (m = gwm.mons; m; m = m->next)
+        for (c = m->clients; c; c = c->next)
+            if (ISVISIBLE(c) && !c->isfloating == !floating)
+                buf[n++] = c;
+    qsort(buf, n, sizeof(Client *), cmpstackseq);
+    return n;
+}
+
+static void commitstack(void)
+{
+    static Client **cbuf = NULL;
+    static int cbufcap = 0;
+    Window *wins;
+    Monitor *m;
+    Client *c;
+    int i, n = 0, nc = 0, nf, nt, nm = 0;
+
+    gwm.stackdirty = 0;
+
+    for (m = gwm.mons; m; m = m->next, nm++)
+        for (c = m->clients; c; c = c->next)
+            nc++;
+
+    if (nc > cbufcap) {
+        cbufcap = nc * 2;
+        free(cbuf);
+        cbuf = ecalloc(cbufcap, sizeof(Client *));
+    }
+    wins = ecalloc(nc + nm + 1, sizeof(Window));
+
+    nf = collectlayer(cbuf, 1);
+    for (i = 0; i < nf; i++)
+        wins[n++] = cbuf[i]->win;
+    wins[n++] = gwm.floating_stack_helper;
+    for (m = gwm.mons; m; m = m->next)
+        wins[n++] = m->barwin;
+    nt = collectlayer(cbuf, 0);
+    for (i = 0; i < nt; i++)
+        wins[n++] = cbuf[i]->win;
+
+    if (n == gwm.nxstack && !memcmp(wins, gwm.xstack, n * sizeof(Window))) {
+        free(wins);
+        return;
+    }
+
+    XRestackWindows(gwm.dpy, wins, n);
+    free(gwm.xstack);
+    gwm.xstack = wins;
+    gwm.nxstack = n;
+}
+
+void commit(void)
+{
+    Monitor *m;
+    Client *c;
+
+    if (gwm.dirty) {
+        gwm.dirty = 0;
+        for (m = gwm.mons; m; m = m->next)
+            for (c = m->clients; c; c = c->next)
+                if (c->dirty)
+                    commitclient(c);
+    }
+    if (gwm.stackdirty)
+        commitstack();
+}
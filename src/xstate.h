@@ -0,0 +1,11 @@
+#pragma once
+
+#include "common.h"
+
+extern void markdirty(Client *c);
+extern void markalldirty(void);
+extern void raiseclient(Client *c);
+extern void lowerclient(Client *c);
+extern void initxstate(Client *c, XWindowAttributes *wa);
+extern void commitclient(Client *c);
+extern void commit(void);